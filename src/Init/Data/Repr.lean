@@ -118,7 +118,8 @@ namespace Nat
 
 /-
 We have pure functions for calculating the decimal representation of a `Nat` (`toDigits`), but also
-a fast variant that handles small numbers (`USize`) via C code (`lean_string_of_usize`).
+a fast variant that handles small numbers (`USize`) via C code (`lean_string_of_usize`), and
+big numbers via the divide-and-conquer conversion of the runtime (`lean_nat_big_repr`).
 -/
 
 def digitChar (n : Nat) : Char :=
@@ -159,10 +160,14 @@ protected def _root_.USize.repr (n : @& USize) : String :=
 private def reprArray : Array String := Id.run do
   List.range 128 |>.map (·.toUSize.repr) |> Array.mk
 
+@[extern "lean_nat_big_repr"]
+private def reprBig (n : @& Nat) : String :=
+  (toDigits 10 n).asString
+
 private def reprFast (n : Nat) : String :=
   if h : n < 128 then Nat.reprArray.get ⟨n, h⟩ else
   if h : n < USize.size then (USize.ofNatCore n h).repr
-  else (toDigits 10 n).asString
+  else reprBig n
 
 @[implemented_by reprFast]
 protected def repr (n : Nat) : String :=
@@ -773,9 +773,14 @@ termination_by s.endPos.1 - i.1
 def isNat (s : String) : Bool :=
   !s.isEmpty && s.all (·.isDigit)
 
+/-- Precondition: `s.isNat`. The runtime converts long strings by divide and conquer. -/
+@[extern "lean_string_dec_to_nat"]
+private def decToNat (s : @& String) : Nat :=
+  s.foldl (fun n c => n*10 + (c.toNat - '0'.toNat)) 0
+
 def toNat? (s : String) : Option Nat :=
   if s.isNat then
-    some <| s.foldl (fun n c => n*10 + (c.toNat - '0'.toNat)) 0
+    some (decToNat s)
   else
     none
 
@@ -431,11 +431,45 @@ If the returned string is empty, an end-of-file marker has been reached.
 Note that EOF does not actually close a handle, so further reads may block and return more data.
 -/
 @[extern "lean_io_prim_handle_get_line"] opaque getLine (h : @& Handle) : IO String
+/--
+Read bytes up to (including) the next occurrence of `delim` from the handle.
+If the returned array is empty, an end-of-file marker has been reached.
+-/
+@[extern "lean_io_prim_handle_read_until"] opaque readUntil (h : @& Handle) (delim : UInt8) : IO ByteArray
+/--
+Read all remaining lines from the handle, without their line breaks.
+-/
+@[extern "lean_io_prim_handle_read_lines"] opaque readLines (h : @& Handle) : IO (Array String)
 @[extern "lean_io_prim_handle_put_str"] opaque putStr (h : @& Handle) (s : @& String) : IO Unit
 
+/--
+Like `read`, but returns at once with a task that is resolved as soon as some data is available,
+reading at most the given number of bytes. Pipes are waited on by the runtime's I/O reactor
+without occupying a thread; elsewhere the read runs on a dedicated thread.
+-/
+@[extern "lean_io_prim_handle_read_async"]
+opaque readAsync (h : @& Handle) (bytes : USize) : BaseIO (Task (Except IO.Error ByteArray)) :=
+  Task.pure <$> (h.read bytes).toBaseIO
+/--
+Like `write`, but returns at once with a task that is resolved when the whole buffer has been written.
+-/
+@[extern "lean_io_prim_handle_write_async"]
+opaque writeAsync (h : @& Handle) (buffer : @& ByteArray) : BaseIO (Task (Except IO.Error Unit)) :=
+  Task.pure <$> (h.write buffer).toBaseIO
+
 end Handle
 
 @[extern "lean_io_realpath"] opaque realPath (fname : FilePath) : IO FilePath
+/--
+Map the contents of the given file into memory, without copying it, and return it as a `ByteArray`.
+The mapping is released when the array is freed. Modifying the array does not modify the file.
+Small files and platforms without memory mapping fall back to `IO.FS.readBinFile`.
+
+The file must not be changed while the array is in use. If another process modifies it, the
+change may or may not become visible in the array, which breaks referential transparency. If the
+file is truncated, accessing the missing part of the array crashes the process with `SIGBUS`.
+-/
+@[extern "lean_io_mmap_file"] opaque mmapFile (fname : @& FilePath) : IO ByteArray
 @[extern "lean_io_remove_file"] opaque removeFile (fname : @& FilePath) : IO Unit
 /-- Remove given directory. Fails if not empty; see also `IO.FS.removeDirAll`. -/
 @[extern "lean_io_remove_dir"] opaque removeDir : @& FilePath → IO Unit
@@ -490,19 +524,9 @@ def readFile (fname : FilePath) : IO String := do
   let h ← Handle.mk fname Mode.read
   h.readToEnd
 
-partial def lines (fname : FilePath) : IO (Array String) := do
+def lines (fname : FilePath) : IO (Array String) := do
   let h ← Handle.mk fname Mode.read
-  let rec read (lines : Array String) := do
-    let line ← h.getLine
-    if line.length == 0 then
-      pure lines
-    else if line.back == '\n' then
-      let line := line.dropRight 1
-      let line := if System.Platform.isWindows && line.back == '\x0d' then line.dropRight 1 else line
-      read <| lines.push line
-    else
-      pure <| lines.push line
-  read #[]
+  h.readLines
 
 def writeBinFile (fname : FilePath) (content : ByteArray) : IO Unit := do
   let h ← Handle.mk fname Mode.write
@@ -714,6 +738,11 @@ structure Child (cfg : StdioConfig) where
 
 @[extern "lean_io_process_child_wait"] opaque Child.wait {cfg : @& StdioConfig} : @& Child cfg → IO UInt32
 
+/-- Like `Child.wait`, but returns at once with a task that is resolved with the exit code of the child. -/
+@[extern "lean_io_process_child_wait_async"]
+opaque Child.waitAsync {cfg : @& StdioConfig} (child : @& Child cfg) : BaseIO (Task (Except IO.Error UInt32)) :=
+  Task.pure <$> child.wait.toBaseIO
+
 /-- Terminates the child process using the SIGTERM signal or a platform analogue.
     If the process was started using `SpawnArgs.setsid`, terminates the entire process group instead. -/
 @[extern "lean_io_process_child_kill"] opaque Child.kill {cfg : @& StdioConfig} : @& Child cfg → IO Unit
@@ -94,6 +94,19 @@ def Ref.modifyGet {σ α β : Type} (r : Ref σ α) (f : α → β × α) : ST 
   Ref.set r a
   pure b
 
+/--
+Like `Ref.modifyGet`, but without emptying the reference while `f` runs: other threads can keep
+reading it, and the new value is only stored if the reference has not been changed concurrently.
+Otherwise, `f` is applied again to the new value, so it may run several times. As `f` does not get
+exclusive access to the value, it cannot be updated in place.
+-/
+@[extern "lean_st_ref_modify_get_cas"]
+opaque Ref.modifyGetCAS {σ α β : Type} (r : @& Ref σ α) (f : α → β × α) : ST σ β := do
+  let v ← Ref.get r
+  let (b, a) := f v
+  Ref.set r a
+  pure b
+
 end Prim
 
 section
@@ -107,6 +120,7 @@ variable {σ : Type} {m : Type → Type} [Monad m] [MonadLiftT (ST σ) m]
 @[inline] def Ref.ptrEq {α : Type} (r1 r2 : Ref σ α) : m Bool := liftM <| Prim.Ref.ptrEq r1 r2
 @[inline] def Ref.modify {α : Type} (r : Ref σ α) (f : α → α) : m Unit := liftM <| Prim.Ref.modify r f
 @[inline] def Ref.modifyGet {α : Type} {β : Type} (r : Ref σ α) (f : α → β × α) : m β := liftM <| Prim.Ref.modifyGet r f
+@[inline] def Ref.modifyGetCAS {α : Type} {β : Type} (r : Ref σ α) (f : α → β × α) : m β := liftM <| Prim.Ref.modifyGetCAS r f
 
 def Ref.toMonadStateOf (r : Ref σ α) : MonadStateOf α m where
   get := r.get
@@ -77,6 +77,12 @@ then one of the following must hold in each (execution) branch.
 3- We extract (aka project) every single field of `x` exactly once. That is, we are consuming `x` by consuming each
    of one of its components. Minor refinement: we don't need to consume scalar fields or struct/union
    fields that do not contain object fields.
+
+Remark: the code generator does not produce `struct` and `union` yet, and the C and LLVM emitters
+reject them. Returning small all-scalar structures (e.g., `UInt64 × UInt64`) unboxed requires
+1- `toIRType` (and `ll_infer_type` in the old code generator) to map them to `struct`,
+2- `ExplicitBoxing` to box/unbox them at `_boxed` wrappers, closures and interpreter calls, and
+3- the emitters to lower `struct` values to C structs / LLVM aggregates.
 -/
 inductive IRType where
   | float | uint8 | uint16 | uint32 | uint64 | usize
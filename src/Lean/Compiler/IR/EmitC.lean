@@ -96,6 +96,13 @@ def shouldExport (n : Name) : Bool :=
   -- libleanshared to avoid Windows symbol limit
   !(`Lean.Compiler.LCNF).isPrefixOf n
 
+/--
+Closed terms of object type are initialized on first access instead of by the module initializer
+when the generated code is compiled with `-DLEAN_LAZY_INIT` (see `lean_closed_term_get` in `lean.h`).
+-/
+def isLazyClosedTerm (env : Environment) (decl : Decl) : Bool :=
+  decl.params.isEmpty && decl.resultType.isObj && isClosedTermName env decl.name
+
 def emitFnDeclAux (decl : Decl) (cppBaseName : String) (isExternal : Bool) : M Unit := do
   let ps := decl.params
   let env ← getEnv
@@ -118,6 +125,9 @@ def emitFnDeclAux (decl : Decl) (cppBaseName : String) (isExternal : Bool) : M U
         emit (toCType ps[i]!.ty)
     emit ")"
   emitLn ";"
+  if isLazyClosedTerm env decl then
+    -- the initializer is referenced by `lean_closed_term_get` before its definition
+    emitLn ("static lean_object* _init_" ++ cppBaseName ++ "();")
 
 def emitFnDecl (decl : Decl) (isExternal : Bool) : M Unit := do
   let cppBaseName ← toCName decl.name
@@ -281,6 +291,56 @@ def isIf (alts : Array Alt) : Option (Nat × FnBody × FnBody) :=
     | Alt.ctor c b => some (c.cidx, b, alts[1]!.body)
     | _            => none
 
+/--
+Functions comparing a variable against a literal in chains of the form
+```
+let y := k₁; let c := f x y; case c of [Bool.false → (let y' := k₂; let c' := f x y'; case c' ...), Bool.true → b₁]
+```
+as produced by `match` on literals. The `Bool` result says whether `x` is a `Nat`.
+-/
+def litCaseFns : List (Name × Bool) :=
+  [(``Nat.decEq, true), (``Nat.beq, true), (``UInt8.decEq, false), (``UInt16.decEq, false),
+   (``UInt32.decEq, false), (``UInt64.decEq, false)]
+
+/--
+If `b` is the first link `let y := k; let c := f x y; case c of ...` of such a chain, return `x`, whether it
+is a `Nat`, `k`, the body for `x = k`, and the body for `x ≠ k`. We only accept literals that are scalars on
+all platforms, and `y` and `c` must not be used by the bodies.
+-/
+def isLitCaseLink (b : FnBody) : Option (VarId × Bool × Nat × FnBody × FnBody) :=
+  match b with
+  | .vdecl y _ (.lit (.num k)) (.vdecl c .uint8 (.fap f #[.var x₁, .var x₂]) (.case _ c' _ alts)) =>
+    match List.lookup f litCaseFns, isIf alts with
+    | some isNat, some (tag, t, e) =>
+      let (eq, ne) := if tag == 1 then (t, e) else (e, t)
+      let x := if x₁ == y then x₂ else x₁
+      if c' == c && (x₁ == y) != (x₂ == y) && k < 2^31 &&
+         !eq.hasFreeVar y && !eq.hasFreeVar c && !ne.hasFreeVar y && !ne.hasFreeVar c then
+        some (x, isNat, k, eq, ne)
+      else
+        none
+    | _, _ => none
+  | _ => none
+
+/--
+Collect the links of a chain of comparisons of `x` started by `isLitCaseLink`. Returns the literals with
+their bodies, and the body for the case where `x` is none of them.
+-/
+partial def collectLitCases (x : VarId) (b : FnBody) (cases : Array (Nat × FnBody)) : Array (Nat × FnBody) × FnBody :=
+  match isLitCaseLink b with
+  | some (x', _, k, eq, ne) =>
+    if x' == x && !cases.any (·.1 == k) then
+      collectLitCases x ne (cases.push (k, eq))
+    else
+      (cases, b)
+  | none => (cases, b)
+
+/--
+Chains with fewer links are left as `if` chains. For longer chains, we emit a `switch` and let the C
+compiler choose between a jump table, bit tests and a binary search based on the density of the literals.
+-/
+def minLitSwitchCases := 3
+
 def emitInc (x : VarId) (n : Nat) (checkRef : Bool) : M Unit := do
   emit $
     if checkRef then (if n == 1 then "lean_inc" else "lean_inc_n")
@@ -428,9 +488,12 @@ def emitFullApp (z : VarId) (f : FunId) (ys : Array Arg) : M Unit := do
   match decl with
   | Decl.extern _ ps _ extData => emitExternCall f ps extData ys
   | _ =>
-    emitCName f
-    if ys.size > 0 then emit "("; emitArgs ys; emit ")"
-    emitLn ";"
+    if isLazyClosedTerm (← getEnv) decl then
+      emit "lean_closed_term_get(&"; emitCName f; emit ", "; emitCInitName f; emitLn ");"
+    else
+      emitCName f
+      if ys.size > 0 then emit "("; emitArgs ys; emit ")"
+      emitLn ";"
 
 def emitPartialApp (z : VarId) (f : FunId) (ys : Array Arg) : M Unit := do
   let decl ← getDecl f
@@ -591,6 +654,9 @@ partial def emitCase (x : VarId) (xType : IRType) (alts : Array Alt) : M Unit :=
   match isIf alts with
   | some (tag, t, e) => emitIf x xType tag t e
   | _ => do
+    -- We leave the choice between a jump table, bit tests and a binary search to the C compiler,
+    -- which picks one based on the density of the case values. Chains of comparisons against
+    -- literals are turned into `switch`es as well, see `emitLitSwitch`.
     emit "switch ("; emitTag x xType; emitLn ") {";
     let alts := ensureHasDefault alts;
     alts.forM fun alt => do
@@ -599,6 +665,21 @@ partial def emitCase (x : VarId) (xType : IRType) (alts : Array Alt) : M Unit :=
       | Alt.default b => emitLn "default: "; emitFnBody b
     emitLn "}"
 
+/--
+Emit a chain of comparisons against literals as a `switch`. Big `Nat`s are never equal to the literals,
+which are scalars, so we map them to the default case.
+-/
+partial def emitLitSwitch (x : VarId) (isNat : Bool) (cases : Array (Nat × FnBody)) (default : FnBody) : M Unit := do
+  emit "switch ("
+  if isNat then
+    emit "lean_is_scalar("; emit x; emit ") ? lean_unbox("; emit x; emit ") : SIZE_MAX"
+  else
+    emit x
+  emitLn ") {"
+  cases.forM fun (k, b) => do emit "case "; emit k; emitLn ":"; emitFnBody b
+  emitLn "default: "; emitFnBody default
+  emitLn "}"
+
 partial def emitBlock (b : FnBody) : M Unit := do
   match b with
   | FnBody.jdecl _ _  _ b      => emitBlock b
@@ -606,6 +687,13 @@ partial def emitBlock (b : FnBody) : M Unit := do
     let ctx ← read
     if isTailCallTo ctx.mainFn d then
       emitTailCall v
+    else if let some (y, isNat, _, _, _) := isLitCaseLink d then
+      let (cases, default) := collectLitCases y d #[]
+      if cases.size >= minLitSwitchCases then
+        emitLitSwitch y isNat cases default
+      else
+        emitVDecl x t v
+        emitBlock b
     else
       emitVDecl x t v
       emitBlock b
@@ -704,7 +792,7 @@ def emitDeclInit (d : Decl) : M Unit := do
     emitLn "if (lean_io_result_is_error(res)) return res;"
     emitLn "lean_dec_ref(res);"
     if isIOUnitBuiltinInitFn env n then
-      emit "}"
+      emitLn "}"
   else if d.params.size == 0 then
     match getInitFnNameFor? env d.name with
     | some initFn =>
@@ -720,9 +808,12 @@ def emitDeclInit (d : Decl) : M Unit := do
         emitMarkPersistent d n
       emitLn "lean_dec_ref(res);"
       if getBuiltinInitFnNameFor? env d.name |>.isSome then
-        emit "}"
+        emitLn "}"
     | _ =>
+      let isLazy := isLazyClosedTerm env d
+      if isLazy then emitLn "#ifndef LEAN_LAZY_INIT"
       emitCName n; emit " = "; emitCInitName n; emitLn "();"; emitMarkPersistent d n
+      if isLazy then emitLn "#endif"
 
 def emitInitFn : M Unit := do
   let env ← getEnv
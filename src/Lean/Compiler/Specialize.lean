@@ -100,6 +100,17 @@ def addEntry (s : SpecState) (e : SpecEntry) : SpecState :=
   | SpecEntry.info name info => { s with specInfo := s.specInfo.insert name info }
   | SpecEntry.cache key fn   => { s with cache    := s.cache.insert key fn }
 
+/--
+Add an entry from an imported module. Independent modules may have specialized the same key.
+We keep the specialization from the module that is imported first (dependencies are imported
+before their dependents), so that all downstream modules reuse the same symbol instead of
+whichever copy happened to be imported last.
+-/
+def addImportedEntry (s : SpecState) (e : SpecEntry) : SpecState :=
+  match e with
+  | SpecEntry.cache key _ => if s.cache.contains key then s else s.addEntry e
+  | _                     => s.addEntry e
+
 def switch : SpecState → SpecState
   | ⟨m₁, m₂⟩ => ⟨m₁.switch, m₂.switch⟩
 
@@ -108,7 +119,7 @@ end SpecState
 builtin_initialize specExtension : SimplePersistentEnvExtension SpecEntry SpecState ←
   registerSimplePersistentEnvExtension {
     addEntryFn    := SpecState.addEntry,
-    addImportedFn := fun es => (mkStateFromImportedEntries SpecState.addEntry {} es).switch
+    addImportedFn := fun es => (mkStateFromImportedEntries SpecState.addImportedEntry {} es).switch
   }
 
 @[export lean_add_specialization_info]
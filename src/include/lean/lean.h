@@ -17,6 +17,7 @@ Author: Leonardo de Moura
 #define LEAN_USING_STD using namespace std; /* NOLINT */
 extern "C" {
 #else
+#include <stdatomic.h>
 #define  LEAN_USING_STD
 #endif
 #include <lean/config.h>
@@ -495,6 +496,28 @@ static inline bool lean_is_shared(lean_object * o) {
 LEAN_EXPORT void lean_mark_mt(lean_object * o);
 LEAN_EXPORT void lean_mark_persistent(lean_object * o);
 
+/* Closed terms extracted by the compiler are computed by the module initializer. When the generated code
+   is compiled with `-DLEAN_LAZY_INIT`, they are instead computed on first access. Closed terms are pure,
+   so threads racing on the first access may all evaluate the term; only one result is published, and the
+   others are freed. While the winner marks its result persistent, the slot contains
+   `LEAN_CLOSED_TERM_BUSY`, which is neither a pointer to an object nor a boxed scalar. */
+#define LEAN_CLOSED_TERM_BUSY ((lean_object *)2)
+LEAN_EXPORT lean_object * lean_closed_term_init(lean_object ** p, lean_object * (*init)(void));
+
+static inline lean_object * lean_closed_term_get(lean_object ** p, lean_object * (*init)(void)) {
+#ifdef LEAN_LAZY_INIT
+    LEAN_USING_STD;
+    lean_object * r = atomic_load_explicit((_Atomic(lean_object *) *)p, memory_order_acquire);
+    /* `r` is `NULL` or `LEAN_CLOSED_TERM_BUSY` */
+    if (LEAN_UNLIKELY(((size_t)r | 2) == 2))
+        r = lean_closed_term_init(p, init);
+    return r;
+#else
+    (void)init;
+    return *p;
+#endif
+}
+
 static inline void lean_set_st_header(lean_object * o, unsigned tag, unsigned other) {
     o->m_rc       = 1;
     o->m_tag      = tag;
@@ -1048,6 +1071,8 @@ static inline uint8_t lean_string_dec_eq(b_lean_obj_arg s1, b_lean_obj_arg s2) {
 static inline uint8_t lean_string_dec_lt(b_lean_obj_arg s1, b_lean_obj_arg s2) { return lean_string_lt(s1, s2); }
 LEAN_EXPORT uint64_t lean_string_hash(b_lean_obj_arg);
 LEAN_EXPORT lean_obj_res lean_string_of_usize(size_t);
+LEAN_EXPORT lean_obj_res lean_nat_big_repr(b_lean_obj_arg n);
+LEAN_EXPORT lean_obj_res lean_string_dec_to_nat(b_lean_obj_arg s);
 
 /* Thunks */
 
@@ -1958,6 +1983,7 @@ LEAN_EXPORT lean_obj_res lean_st_ref_get(b_lean_obj_arg, lean_obj_arg);
 LEAN_EXPORT lean_obj_res lean_st_ref_set(b_lean_obj_arg, lean_obj_arg, lean_obj_arg);
 LEAN_EXPORT lean_obj_res lean_st_ref_reset(b_lean_obj_arg, lean_obj_arg);
 LEAN_EXPORT lean_obj_res lean_st_ref_swap(b_lean_obj_arg, lean_obj_arg, lean_obj_arg);
+LEAN_EXPORT lean_obj_res lean_st_ref_modify_get_cas(b_lean_obj_arg, lean_obj_arg, lean_obj_arg);
 
 /* pointer address unsafe primitive  */
 static inline size_t lean_ptr_addr(b_lean_obj_arg a) { return (size_t)a; }
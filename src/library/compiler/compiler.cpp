@@ -4,8 +4,15 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <string>
+#include <map>
+#include <unordered_set>
+#include <chrono>
+#include "runtime/mutex.h"
+#include "runtime/sstream.h"
 #include "util/option_declarations.h"
 #include "util/io.h"
+#include "util/timeit.h"
 #include "kernel/type_checker.h"
 #include "kernel/kernel_exception.h"
 #include "kernel/trace.h"
@@ -34,8 +41,118 @@ Author: Leonardo de Moura
 
 namespace lean {
 static name * g_extract_closed = nullptr;
+static name * g_compiler_stats = nullptr;
 
 bool is_extract_closed_enabled(options const & opts) { return opts.get_bool(*g_extract_closed, true); }
+bool is_compiler_stats_enabled(options const & opts) { return opts.get_bool(*g_compiler_stats, false); }
+
+/* Cumulative statistics for a single compiler pass, see `compiler.stats`. */
+struct compiler_pass_stats {
+    second_duration m_time{0};
+    unsigned        m_num_runs{0};
+    size_t          m_size_before{0};
+    size_t          m_size_after{0};
+    /* Declaration on which this pass spent the most time. */
+    name            m_slowest_decl;
+    second_duration m_slowest_time{0};
+};
+
+static std::map<std::string, compiler_pass_stats> * g_compiler_pass_stats = nullptr;
+static mutex * g_compiler_pass_stats_mutex = nullptr;
+
+/* Number of distinct expression objects reachable from `ds`, used as a code size measure.
+   Unlike the size of the expression trees, it does not grow when a pass shares subterms. */
+static size_t get_comp_decls_size(comp_decls const & ds) {
+    std::unordered_set<object *> visited;
+    buffer<expr const *> todo;
+    for (comp_decl const & d : ds)
+        todo.push_back(&d.snd());
+    while (!todo.empty()) {
+        expr const & e = *todo.back();
+        todo.pop_back();
+        if (!visited.insert(e.raw()).second)
+            continue;
+        switch (e.kind()) {
+        case expr_kind::Const: case expr_kind::BVar:
+        case expr_kind::Sort:  case expr_kind::Lit:
+        case expr_kind::MVar:  case expr_kind::FVar:
+            break;
+        case expr_kind::MData:
+            todo.push_back(&mdata_expr(e));
+            break;
+        case expr_kind::Proj:
+            todo.push_back(&proj_expr(e));
+            break;
+        case expr_kind::App:
+            todo.push_back(&app_arg(e));
+            todo.push_back(&app_fn(e));
+            break;
+        case expr_kind::Lambda: case expr_kind::Pi:
+            todo.push_back(&binding_body(e));
+            todo.push_back(&binding_domain(e));
+            break;
+        case expr_kind::Let:
+            todo.push_back(&let_body(e));
+            todo.push_back(&let_value(e));
+            todo.push_back(&let_type(e));
+            break;
+        }
+    }
+    return visited.size();
+}
+
+/* Record time and code size of a compiler pass for the declarations in `ds`.
+   The size "after" is measured when the object is destroyed, so `ds` should be the variable
+   updated by the pass. */
+class compiler_pass_timer {
+    char const *                          m_pass;
+    name                                  m_decl;
+    comp_decls const &                    m_ds;
+    bool                                  m_enabled;
+    size_t                                m_size_before{0};
+    std::chrono::steady_clock::time_point m_start;
+public:
+    compiler_pass_timer(char const * pass, options const & opts, name const & decl, comp_decls const & ds):
+        m_pass(pass), m_decl(decl), m_ds(ds), m_enabled(is_compiler_stats_enabled(opts)) {
+        if (m_enabled) {
+            m_size_before = get_comp_decls_size(ds);
+            m_start       = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~compiler_pass_timer() {
+        if (!m_enabled)
+            return;
+        second_duration time = std::chrono::steady_clock::now() - m_start;
+        size_t size_after    = get_comp_decls_size(m_ds);
+        lock_guard<mutex> _(*g_compiler_pass_stats_mutex);
+        compiler_pass_stats & s = (*g_compiler_pass_stats)[m_pass];
+        s.m_time        += time;
+        s.m_num_runs++;
+        s.m_size_before += m_size_before;
+        s.m_size_after  += size_after;
+        if (time > s.m_slowest_time) {
+            s.m_slowest_time = time;
+            s.m_slowest_decl = m_decl;
+        }
+    }
+};
+
+void display_cumulative_compiler_stats(std::ostream & out) {
+    lock_guard<mutex> _(*g_compiler_pass_stats_mutex);
+    if (g_compiler_pass_stats->empty())
+        return;
+    sstream ss;
+    ss << "cumulative compiler pass statistics:\n";
+    for (auto const & p : *g_compiler_pass_stats) {
+        compiler_pass_stats const & s = p.second;
+        ss << "\t" << p.first << " " << display_profiling_time{s.m_time}
+           << ", " << s.m_num_runs << " runs, size " << s.m_size_before << " -> " << s.m_size_after
+           << ", slowest " << s.m_slowest_decl << " (" << display_profiling_time{s.m_slowest_time} << ")\n";
+    }
+    // output atomically, like IO.print
+    out << ss.str();
+}
 
 static name get_real_name(name const & n) {
     if (optional<name> new_n = is_unsafe_rec_name(n))
@@ -200,26 +317,42 @@ environment compile(environment const & env, options const & opts, names cs) {
 
     comp_decls ds = to_comp_decls(env, cs);
     csimp_cfg cfg(opts);
+    name decl = head(cs);
     // Use the following line to see compiler intermediate steps
     // scope_traces_as_string trace_scope;
     auto simp  = [&](environment const & env, expr const & e) { return csimp(env, e, cfg); };
     auto esimp = [&](environment const & env, expr const & e) { return cesimp(env, e, cfg); };
     trace_compiler(name({"compiler", "input"}), ds);
-    ds = apply(eta_expand, env, ds);
+    {
+        compiler_pass_timer _("eta_expand", opts, decl, ds);
+        ds = apply(eta_expand, env, ds);
+    }
     trace_compiler(name({"compiler", "eta_expand"}), ds);
-    ds = apply(to_lcnf, env, ds);
-    ds = apply(find_jp, env, ds);
+    {
+        compiler_pass_timer _("to_lcnf", opts, decl, ds);
+        ds = apply(to_lcnf, env, ds);
+        ds = apply(find_jp, env, ds);
+    }
     // trace(ds);
     trace_compiler(name({"compiler", "lcnf"}), ds);
     // trace(ds);
-    ds = apply(cce, env, ds);
+    {
+        compiler_pass_timer _("cce", opts, decl, ds);
+        ds = apply(cce, env, ds);
+    }
     trace_compiler(name({"compiler", "cce"}), ds);
-    ds = apply(csimp_replace_constants, env, ds);
-    ds = apply(simp, env, ds);
+    {
+        compiler_pass_timer _("csimp", opts, decl, ds);
+        ds = apply(csimp_replace_constants, env, ds);
+        ds = apply(simp, env, ds);
+    }
     trace_compiler(name({"compiler", "simp"}), ds);
     // trace(ds);
     environment new_env = env;
-    std::tie(new_env, ds) = eager_lambda_lifting(new_env, ds, cfg);
+    {
+        compiler_pass_timer _("eager_lambda_lifting", opts, decl, ds);
+        std::tie(new_env, ds) = eager_lambda_lifting(new_env, ds, cfg);
+    }
     trace_compiler(name({"compiler", "eager_lambda_lifting"}), ds);
     ds = apply(max_sharing, ds);
     trace_compiler(name({"compiler", "stage1"}), ds);
@@ -233,43 +366,69 @@ environment compile(environment const & env, options const & opts, names cs) {
            when it is partially applied. Then, we can mark all `match` auxiliary functions as `[strong_inline]` */
         return new_env;
     }
-    std::tie(new_env, ds) = specialize(new_env, ds, cfg);
+    {
+        compiler_pass_timer _("specialize", opts, decl, ds);
+        std::tie(new_env, ds) = specialize(new_env, ds, cfg);
+    }
     // The following check is incorrect. It was exposed by issue #1812.
     // We will not fix the check since we will delete the compiler.
     // lean_assert(lcnf_check_let_decls(new_env, ds));
     trace_compiler(name({"compiler", "specialize"}), ds);
     ds = apply(elim_dead_let, ds);
     trace_compiler(name({"compiler", "elim_dead_let"}), ds);
-    ds = apply(erase_irrelevant, new_env, ds);
+    {
+        compiler_pass_timer _("erase_irrelevant", opts, decl, ds);
+        ds = apply(erase_irrelevant, new_env, ds);
+    }
     trace_compiler(name({"compiler", "erase_irrelevant"}), ds);
     ds = apply(struct_cases_on, new_env, ds);
     trace_compiler(name({"compiler", "struct_cases_on"}), ds);
-    ds = apply(esimp, new_env, ds);
+    {
+        compiler_pass_timer _("csimp", opts, decl, ds);
+        ds = apply(esimp, new_env, ds);
+    }
     trace_compiler(name({"compiler", "simp"}), ds);
     ds = reduce_arity(new_env, ds);
     trace_compiler(name({"compiler", "reduce_arity"}), ds);
-    std::tie(new_env, ds) = lambda_lifting(new_env, ds);
+    {
+        compiler_pass_timer _("lambda_lifting", opts, decl, ds);
+        std::tie(new_env, ds) = lambda_lifting(new_env, ds);
+    }
     trace_compiler(name({"compiler", "lambda_lifting"}), ds);
     // trace(ds);
-    ds = apply(esimp, new_env, ds);
+    {
+        compiler_pass_timer _("csimp", opts, decl, ds);
+        ds = apply(esimp, new_env, ds);
+    }
     trace_compiler(name({"compiler", "simp"}), ds);
     new_env = cache_stage2(new_env, ds);
     trace_compiler(name({"compiler", "stage2"}), ds);
     if (is_extract_closed_enabled(opts)) {
+        compiler_pass_timer _("extract_closed", opts, decl, ds);
         std::tie(new_env, ds) = extract_closed(new_env, ds);
         ds = apply(elim_dead_let, ds);
         ds = apply(esimp, new_env, ds);
         trace_compiler(name({"compiler", "extract_closed"}), ds);
     }
     new_env = cache_new_stage2(new_env, ds);
-    ds = apply(esimp, new_env, ds);
+    {
+        compiler_pass_timer _("csimp", opts, decl, ds);
+        ds = apply(esimp, new_env, ds);
+    }
     trace_compiler(name({"compiler", "simp"}), ds);
-    ds = apply(simp_app_args, new_env, ds);
-    ds = apply(ecse, new_env, ds);
-    ds = apply(elim_dead_let, ds);
+    {
+        compiler_pass_timer _("simp_app_args", opts, decl, ds);
+        ds = apply(simp_app_args, new_env, ds);
+    }
+    {
+        compiler_pass_timer _("ecse", opts, decl, ds);
+        ds = apply(ecse, new_env, ds);
+        ds = apply(elim_dead_let, ds);
+    }
     trace_compiler(name({"compiler", "simp_app_args"}), ds);
     // std::cout << trace_scope.get_string() << "\n";
-    /* compile IR. */
+    /* compile IR. The IR is not a `comp_decls`, so the size reported for this pass is the size of its input. */
+    compiler_pass_timer _("compile_ir", opts, decl, ds);
     return compile_ir(new_env, opts, ds);
 }
 
@@ -283,6 +442,11 @@ void initialize_compiler() {
     g_extract_closed = new name{"compiler", "extract_closed"};
     mark_persistent(g_extract_closed->raw());
     register_bool_option(*g_extract_closed, true, "(compiler) enable/disable closed term caching");
+    g_compiler_stats = new name{"compiler", "stats"};
+    mark_persistent(g_compiler_stats->raw());
+    register_bool_option(*g_compiler_stats, false, "(compiler) report the time spent in each compiler pass and its effect on code size at the end");
+    g_compiler_pass_stats       = new std::map<std::string, compiler_pass_stats>;
+    g_compiler_pass_stats_mutex = new mutex;
     register_trace_class("compiler");
     register_trace_class({"compiler", "input"});
     register_trace_class({"compiler", "inline"});
@@ -324,6 +488,9 @@ void initialize_compiler() {
 }
 
 void finalize_compiler() {
+    delete g_compiler_pass_stats_mutex;
+    delete g_compiler_pass_stats;
+    delete g_compiler_stats;
     delete g_extract_closed;
 }
 }
@@ -5,12 +5,15 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #pragma once
+#include <iostream>
 #include "kernel/environment.h"
 namespace lean {
 environment compile(environment const & env, options const & opts, names cs);
 inline environment compile(environment const & env, options const & opts, name const & c) {
     return compile(env, opts, names(c));
 }
+/* Print the statistics collected for each compiler pass when `compiler.stats` is set. */
+void display_cumulative_compiler_stats(std::ostream & out);
 void initialize_compiler();
 void finalize_compiler();
 }
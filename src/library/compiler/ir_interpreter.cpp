@@ -25,6 +25,10 @@ code by checking for the mangled symbol via dlsym/GetProcAddress, which is also
 functions, which have a (relatively) homogeneous ABI that we can use without runtime code generation; see also
 `call/lookup_symbol` below.
 
+When the environment variable `LEAN_PERF_MAP` is set on x86-64 Linux, the body of each interpreted declaration is
+evaluated through a tiny trampoline of its own, whose address range is recorded in `/tmp/perf-<pid>.map`. Profilers
+such as `perf` then show the interpreted declarations as callers of the interpreter code in their call graphs.
+
 */
 #include <string>
 #include <vector>
@@ -34,6 +38,13 @@ functions, which have a (relatively) homogeneous ABI that we can use without run
 #else
 #include <dlfcn.h>
 #endif
+#if defined(__linux__) && defined(__x86_64__)
+#define LEAN_PERF_MAP
+#include <sys/mman.h>
+#include <unistd.h>
+// provided by the unwinder (`libgcc_s`), takes the start of an `.eh_frame` section
+extern "C" void __register_frame(void * begin);
+#endif
 #include "runtime/flet.h"
 #include "runtime/apply.h"
 #include "runtime/interrupt.h"
@@ -42,6 +53,7 @@ functions, which have a (relatively) homogeneous ABI that we can use without run
 #include "runtime/array_ref.h"
 #include "kernel/trace.h"
 #include "library/time_task.h"
+#include "library/cpu_profiler.h"
 #include "library/compiler/ir.h"
 #include "library/compiler/init_attribute.h"
 #include "util/nat.h"
@@ -319,6 +331,131 @@ void * lookup_symbol_in_cur_exe(char const * sym) {
 #endif
 }
 
+#ifdef LEAN_PERF_MAP
+/** \brief Trampolines for attributing interpreted code to declarations in `perf` (see top of file).
+
+    All trampolines have the same code, which sets up a frame and calls a fixed target function:
+    ```
+    push %rbp; mov %rsp, %rbp; movabs $target, %rax; call *%rax; pop %rbp; ret
+    ```
+    As they do not touch argument or return registers, they can be called with the signature of the target.
+    Exceptions thrown by the target need call frame information for the trampolines, which we register
+    with the unwinder for each chunk. */
+class perf_map {
+    static constexpr size_t trampoline_size = 32;
+    static constexpr size_t chunk_size      = 64 * 1024;
+    static constexpr size_t cie_size        = 24;
+    static constexpr size_t fde_size        = 40;
+    // a CIE, an FDE per trampoline and the terminating zero length
+    static constexpr size_t eh_frame_size   = cie_size + chunk_size / trampoline_size * fde_size + 4;
+
+    mutex            m_mutex;
+    FILE *           m_file;
+    void *           m_target;
+    name_map<void *> m_trampolines;
+    char *           m_chunk      = nullptr;
+    size_t           m_chunk_used = chunk_size;
+
+    /* Write the `.eh_frame` section describing the trampolines of the chunk at `code` to `p`. */
+    static void write_eh_frame(unsigned char * p, char * code) {
+        /* version 1, no augmentation, code alignment 1, data alignment -8, return address in column 16 (%rip);
+           on entry, the CFA is %rsp + 8 and the return address is saved at CFA - 8 */
+        unsigned char cie[cie_size] = {
+            20, 0, 0, 0,        // length
+            0, 0, 0, 0,         // CIE id
+            1, 0, 1, 0x78, 16,
+            0x0c, 7, 8,         // DW_CFA_def_cfa %rsp, 8
+            0x90, 1,            // DW_CFA_offset %rip, CFA - 8
+            0, 0, 0, 0, 0, 0    // DW_CFA_nop
+        };
+        unsigned char insns[] = {
+            0x41,               // DW_CFA_advance_loc 1: after `push %rbp`
+            0x0e, 16,           // DW_CFA_def_cfa_offset 16
+            0x86, 2,            // DW_CFA_offset %rbp, CFA - 16
+            0x43,               // DW_CFA_advance_loc 3: after `mov %rsp, %rbp`
+            0x0d, 6,            // DW_CFA_def_cfa_register %rbp
+            0x4d,               // DW_CFA_advance_loc 13: after `pop %rbp`
+            0x0c, 7, 8,         // DW_CFA_def_cfa %rsp, 8
+            0xc6,               // DW_CFA_restore %rbp
+            0, 0, 0             // DW_CFA_nop
+        };
+        static_assert(8 + 2 * sizeof(void *) + sizeof(insns) == fde_size, "unexpected FDE size");
+        std::copy(cie, cie + cie_size, p);
+        for (size_t i = 0; i < chunk_size / trampoline_size; i++) {
+            unsigned char * fde = p + cie_size + i * fde_size;
+            uint32_t len     = fde_size - 4;
+            // offset of the CIE from the CIE pointer field
+            uint32_t cie_ptr = static_cast<uint32_t>(fde + 4 - p);
+            char * begin     = code + i * trampoline_size;
+            uint64_t range   = trampoline_size;
+            memcpy(fde, &len, 4);
+            memcpy(fde + 4, &cie_ptr, 4);
+            memcpy(fde + 8, &begin, 8);
+            memcpy(fde + 16, &range, 8);
+            std::copy(insns, insns + sizeof(insns), fde + 24);
+        }
+        memset(p + eh_frame_size - 4, 0, 4);
+    }
+
+    /* Map a new chunk of trampolines followed by their call frame information. Since the trampolines are all
+       identical, the chunk is never written to again. */
+    void new_chunk() {
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t eh_frame_pages = (eh_frame_size + page_size - 1) / page_size * page_size;
+        void * p = mmap(nullptr, chunk_size + eh_frame_pages, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw exception("failed to allocate interpreter trampolines");
+        unsigned char code[trampoline_size];
+        std::fill(code, code + trampoline_size, 0xcc); // int3
+        unsigned char prologue[] = { 0x55, 0x48, 0x89, 0xe5, 0x48, 0xb8 };
+        unsigned char epilogue[] = { 0xff, 0xd0, 0x5d, 0xc3 };
+        std::copy(prologue, prologue + sizeof(prologue), code);
+        memcpy(code + sizeof(prologue), &m_target, sizeof(void *));
+        std::copy(epilogue, epilogue + sizeof(epilogue), code + sizeof(prologue) + sizeof(void *));
+        for (size_t i = 0; i < chunk_size; i += trampoline_size)
+            memcpy(static_cast<char *>(p) + i, code, trampoline_size);
+        unsigned char * eh_frame = static_cast<unsigned char *>(p) + chunk_size;
+        write_eh_frame(eh_frame, static_cast<char *>(p));
+        if (mprotect(p, chunk_size, PROT_READ | PROT_EXEC) != 0 ||
+            mprotect(eh_frame, eh_frame_pages, PROT_READ) != 0)
+            throw exception("failed to allocate interpreter trampolines");
+        __register_frame(eh_frame);
+        m_chunk      = static_cast<char *>(p);
+        m_chunk_used = 0;
+    }
+
+public:
+    perf_map(void * target):m_target(target) {
+        std::string fn = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+        m_file = fopen(fn.c_str(), "w");
+        if (!m_file)
+            throw exception(sstream() << "failed to create '" << fn << "'");
+    }
+
+    ~perf_map() {
+        // trampolines may still be on the stack of other threads, keep them mapped and registered
+        fclose(m_file);
+    }
+
+    void * get_trampoline(name const & fn) {
+        lock_guard<mutex> _(m_mutex);
+        if (void * const * t = m_trampolines.find(fn))
+            return *t;
+        if (m_chunk_used == chunk_size)
+            new_chunk();
+        void * t = m_chunk + m_chunk_used;
+        m_chunk_used += trampoline_size;
+        m_trampolines.insert(fn, t);
+        fprintf(m_file, "%lx %lx %s [interpreted]\n", reinterpret_cast<unsigned long>(t),
+                static_cast<unsigned long>(trampoline_size), fn.to_string().c_str());
+        fflush(m_file);
+        return t;
+    }
+};
+
+static perf_map * g_perf_map = nullptr;
+#endif
+
 class interpreter;
 LEAN_THREAD_PTR(interpreter, g_interpreter);
 
@@ -336,6 +473,8 @@ class interpreter {
         frame(name const & mFn, size_t mArgBp, size_t mJpBp) : m_fn(mFn), m_arg_bp(mArgBp), m_jp_bp(mJpBp) {}
     };
     std::vector<frame> m_call_stack;
+    // depth of the interpreted call stack reported to the CPU profiler when this interpreter was created
+    unsigned m_profiler_base;
     environment const & m_env;
     options const & m_opts;
     // if `false`, use IR code where possible
@@ -352,6 +491,8 @@ class interpreter {
         void * m_addr;
         // true iff we chose the boxed version of a function where the IR uses the unboxed version
         bool m_boxed;
+        // `perf` trampoline for evaluating the body of the declaration, see `eval_decl_body`
+        void * m_trampoline;
     };
     // caches symbol lookup successes _and_ failures
     name_map<symbol_cache_entry> m_symbol_cache;
@@ -728,7 +869,8 @@ private:
     }
 
     // specify argument base pointer explicitly because we've usually already pushed some function arguments
-    void push_frame(decl const & d, size_t arg_bp) {
+    // `caller_frame` is the frame address of the function evaluating the body, used by the CPU profiler
+    void push_frame(decl const & d, size_t arg_bp, void * caller_frame) {
         DEBUG_CODE({
             lean_trace(name({"interpreter", "call"}),
                        tout() << std::string(m_call_stack.size(), ' ')
@@ -739,12 +881,16 @@ private:
                        tout() << "\n";);
         });
         m_call_stack.emplace_back(decl_fun_id(d), arg_bp, m_jp_stack.size());
+        if (g_cpu_profiler_enabled)
+            cpu_profiler_set_interp_frame(m_profiler_base + m_call_stack.size() - 1, decl_fun_id(d), caller_frame);
     }
 
     void pop_frame(value DEBUG_CODE(r), type DEBUG_CODE(t)) {
         m_arg_stack.resize(get_frame().m_arg_bp);
         m_jp_stack.resize(get_frame().m_jp_bp);
         m_call_stack.pop_back();
+        if (g_cpu_profiler_enabled)
+            cpu_profiler_set_interp_depth(m_profiler_base + m_call_stack.size());
         DEBUG_CODE({
             lean_trace(name({"interpreter", "call"}),
                        tout() << std::string(m_call_stack.size(), ' ')
@@ -759,7 +905,7 @@ private:
         if (symbol_cache_entry const * e = m_symbol_cache.find(fn)) {
             return *e;
         } else {
-            symbol_cache_entry e_new { get_decl(fn), nullptr, false };
+            symbol_cache_entry e_new { get_decl(fn), nullptr, false, nullptr };
             if (m_prefer_native || decl_tag(e_new.m_decl) == decl_kind::Extern || has_init_attribute(m_env, fn)) {
                 string_ref mangled = name_mangle(fn, *g_mangle_prefix);
                 string_ref boxed_mangled(string_append(mangled.to_obj_arg(), g_boxed_mangled_suffix->raw()));
@@ -772,11 +918,22 @@ private:
                     e_new.m_addr = p;
                 }
             }
+#ifdef LEAN_PERF_MAP
+            if (g_perf_map && !e_new.m_addr)
+                e_new.m_trampoline = g_perf_map->get_trampoline(fn);
+#endif
             m_symbol_cache.insert(fn, e_new);
             return e_new;
         }
     }
 
+    /** \brief Evaluate the body of an interpreted declaration, going through its `perf` trampoline if any. */
+    value eval_decl_body(decl const & d, void * trampoline) {
+        if (trampoline)
+            return reinterpret_cast<value (*)(interpreter *, decl const *)>(trampoline)(this, &d);
+        return eval_body(decl_fun_body(d));
+    }
+
     /** \brief Retrieve Lean declaration from environment. */
     decl get_decl(name const & fn) {
         option_ref<decl> d = find_ir_decl(m_env, fn);
@@ -823,8 +980,8 @@ private:
             // We don't know whether `[init]` decls can be re-executed, so let's not.
             throw exception(sstream() << "cannot evaluate `[init]` declaration '" << fn << "' in the same module");
         }
-        push_frame(e.m_decl, m_arg_stack.size());
-        value r = eval_body(decl_fun_body(e.m_decl));
+        push_frame(e.m_decl, m_arg_stack.size(), __builtin_frame_address(0));
+        value r = eval_decl_body(e.m_decl, e.m_trampoline);
         pop_frame(r, decl_type(e.m_decl));
         if (!type_is_scalar(t)) {
             inc(r.m_obj);
@@ -850,7 +1007,7 @@ private:
                     inc(args2[i]);
                 }
             }
-            push_frame(e.m_decl, old_size);
+            push_frame(e.m_decl, old_size, __builtin_frame_address(0));
             object * o = curry(e.m_addr, args.size(), args2);
             type t = decl_type(e.m_decl);
             if (type_is_scalar(t)) {
@@ -874,8 +1031,8 @@ private:
             for (const auto & arg : args) {
                 m_arg_stack.push_back(eval_arg(arg));
             }
-            push_frame(e.m_decl, old_size);
-            r = eval_body(decl_fun_body(e.m_decl));
+            push_frame(e.m_decl, old_size, __builtin_frame_address(0));
+            r = eval_decl_body(e.m_decl, e.m_trampoline);
         }
         pop_frame(r, decl_type(e.m_decl));
         return r;
@@ -888,8 +1045,8 @@ private:
         for (size_t i = 0; i < decl_params(d).size(); i++) {
             m_arg_stack.push_back(args[3 + i]);
         }
-        push_frame(d, old_size);
-        object * r = eval_body(decl_fun_body(d)).m_obj;
+        push_frame(d, old_size, __builtin_frame_address(0));
+        object * r = eval_decl_body(d, lookup_symbol(decl_fun_id(d)).m_trampoline).m_obj;
         pop_frame(r, type::TObject);
         return r;
     }
@@ -944,13 +1101,21 @@ private:
         }
     }
 public:
-    explicit interpreter(environment const & env, options const & opts) : m_env(env), m_opts(opts) {
+    explicit interpreter(environment const & env, options const & opts) :
+        m_profiler_base(cpu_profiler_get_interp_depth()), m_env(env), m_opts(opts) {
         m_prefer_native = opts.get_bool(*g_interpreter_prefer_native, LEAN_DEFAULT_INTERPRETER_PREFER_NATIVE);
     }
 
     interpreter(interpreter const &) = delete;
 
+    /** \brief Target of `perf` trampolines. */
+    static value eval_decl_body_core(interpreter * self, decl const * d) {
+        return self->eval_body(decl_fun_body(*d));
+    }
+
     ~interpreter() {
+        // frames are not popped when unwinding exceptions
+        cpu_profiler_set_interp_depth(m_profiler_base);
         for_each(m_constant_cache, [](name const &, constant_cache_entry const & e) {
             if (!e.m_is_scalar) {
                 dec(e.m_val.m_obj);
@@ -1114,6 +1279,10 @@ void initialize_ir_interpreter() {
     mark_persistent(ir::g_boxed_mangled_suffix->raw());
     ir::g_interpreter_prefer_native = new name({"interpreter", "prefer_native"});
     ir::g_init_globals = new name_map<object *>();
+#ifdef LEAN_PERF_MAP
+    if (getenv("LEAN_PERF_MAP"))
+        ir::g_perf_map = new ir::perf_map(reinterpret_cast<void *>(&ir::interpreter::eval_decl_body_core));
+#endif
     register_bool_option(*ir::g_interpreter_prefer_native, LEAN_DEFAULT_INTERPRETER_PREFER_NATIVE, "(interpreter) whether to use precompiled code where available");
     DEBUG_CODE({
         register_trace_class({"interpreter"});
@@ -1123,6 +1292,9 @@ void initialize_ir_interpreter() {
 }
 
 void finalize_ir_interpreter() {
+#ifdef LEAN_PERF_MAP
+    delete ir::g_perf_map;
+#endif
     delete ir::g_init_globals;
     delete ir::g_interpreter_prefer_native;
     delete ir::g_boxed_mangled_suffix;
@@ -0,0 +1,437 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "runtime/thread.h"
+#include "runtime/exception.h"
+#include "runtime/sstream.h"
+#include "runtime/stackinfo.h"
+#include "library/name_demangle.h"
+#include "library/cpu_profiler.h"
+
+#if defined(__linux__) && !defined(LEAN_EMSCRIPTEN) && (defined(__x86_64__) || defined(__aarch64__))
+#define LEAN_CPU_PROFILER
+#include <signal.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <dlfcn.h>
+#include <ucontext.h>
+#include <cxxabi.h>
+#endif
+
+#define LEAN_CPU_PROFILER_MAX_NATIVE_FRAMES 256
+#define LEAN_CPU_PROFILER_MAX_INTERP_FRAMES 256
+// number of words of each of the two sample buffers
+#define LEAN_CPU_PROFILER_BUFFER_SIZE (1u << 20)
+// interval in milliseconds at which the collector thread aggregates samples
+#define LEAN_CPU_PROFILER_COLLECT_INTERVAL 50
+
+namespace lean {
+bool g_cpu_profiler_enabled = false;
+
+/* Interpreted call stack of a thread, read by the signal handler. */
+struct interp_frames {
+    unsigned                     m_depth{0};
+    object *                     m_fns[LEAN_CPU_PROFILER_MAX_INTERP_FRAMES];
+    uintptr_t                    m_sps[LEAN_CPU_PROFILER_MAX_INTERP_FRAMES];
+    /* names of this thread already kept alive by `g_pinned_names` */
+    std::unordered_set<object *> m_pinned;
+};
+
+LEAN_THREAD_PTR(interp_frames, g_interp_frames);
+static mutex * g_pinned_names_mutex = nullptr;
+/* Names of interpreted declarations that may occur in samples. We keep them alive until the
+   profile has been written since the declarations may be dropped while profiling. */
+static std::vector<object *> * g_pinned_names = nullptr;
+
+static void finalize_interp_frames(void * p) {
+    // unregister first, the thread may still receive signals
+    g_interp_frames = nullptr;
+    delete reinterpret_cast<interp_frames *>(p);
+}
+
+static interp_frames & get_interp_frames() {
+    if (!g_interp_frames) {
+        g_interp_frames = new interp_frames();
+        register_thread_finalizer(finalize_interp_frames, g_interp_frames);
+    }
+    return *g_interp_frames;
+}
+
+void cpu_profiler_set_interp_frame(unsigned i, name const & fn, void * sp) {
+    interp_frames & fs = get_interp_frames();
+    if (i < LEAN_CPU_PROFILER_MAX_INTERP_FRAMES) {
+        object * o = fn.raw();
+        if (fs.m_pinned.insert(o).second) {
+            inc(o);
+            lock_guard<mutex> _(*g_pinned_names_mutex);
+            g_pinned_names->push_back(o);
+        }
+        fs.m_fns[i] = o;
+        fs.m_sps[i] = reinterpret_cast<uintptr_t>(sp);
+    }
+    // the frame must be complete before the signal handler can see it
+    std::atomic_signal_fence(std::memory_order_release);
+    fs.m_depth = i + 1;
+}
+
+void cpu_profiler_set_interp_depth(unsigned depth) {
+    if (g_interp_frames)
+        g_interp_frames->m_depth = depth;
+}
+
+unsigned cpu_profiler_get_interp_depth() {
+    return g_interp_frames ? g_interp_frames->m_depth : 0;
+}
+
+#ifdef LEAN_CPU_PROFILER
+/* Samples are appended by the signal handler to the current buffer, which the collector thread
+   periodically swaps with the other one before aggregating it. A sample consists of a header word
+   `num_native | (num_interp << 16)` followed by `(ip, sp)` pairs of the native frames, innermost
+   first, and `(name, sp)` pairs of the interpreted frames, outermost first. */
+struct sample_buffer {
+    std::atomic<size_t>   m_used{0};
+    /* number of signal handlers currently writing to the buffer */
+    std::atomic<unsigned> m_writers{0};
+    uintptr_t             m_data[LEAN_CPU_PROFILER_BUFFER_SIZE];
+};
+
+/* Stack of frames, root first. Interpreted frames are tagged by setting the highest bit of the name
+   pointer, which is never set in user space addresses. */
+typedef std::vector<uintptr_t> stack_key;
+static constexpr uintptr_t g_interp_frame_tag = static_cast<uintptr_t>(1) << (8 * sizeof(uintptr_t) - 1);
+
+struct stack_key_hash {
+    size_t operator()(stack_key const & k) const {
+        size_t h = k.size();
+        for (uintptr_t f : k)
+            h = h * 31 + std::hash<uintptr_t>()(f);
+        return h;
+    }
+};
+
+class cpu_profiler {
+    std::string                                         m_out_fn;
+    sample_buffer *                                     m_buffers[2];
+    std::atomic<sample_buffer *>                        m_current;
+    std::atomic<uint64_t>                               m_num_dropped{0};
+    std::unordered_map<stack_key, uint64_t, stack_key_hash> m_stacks;
+    uint64_t                                            m_num_samples{0};
+    mutex                                               m_mutex;
+    condition_variable                                  m_cv;
+    bool                                                m_stop{false};
+    std::unique_ptr<lthread>                            m_collector;
+    struct sigaction                                    m_old_action;
+
+    /* Walk the frame pointer chain of the thread interrupted at context `uctx`, storing `(ip, sp)` pairs in
+       `frames`, innermost first. `_Unwind_Backtrace` is not async-signal-safe as it takes the locks of the
+       dynamic loader and of registered frames (see `perf_map` in the IR interpreter), so we cannot use it here.
+       We only read memory between the interrupted stack pointer and the base of the thread's stack, so a
+       broken chain, e.g. in code compiled without frame pointers, merely truncates the stack. */
+    static unsigned walk_frames(void * uctx, uintptr_t * frames) {
+        mcontext_t const & mc = static_cast<ucontext_t *>(uctx)->uc_mcontext;
+#if defined(__x86_64__)
+        uintptr_t ip = mc.gregs[REG_RIP];
+        uintptr_t sp = mc.gregs[REG_RSP];
+        uintptr_t fp = mc.gregs[REG_RBP];
+#else
+        uintptr_t ip = mc.pc;
+        uintptr_t sp = mc.sp;
+        uintptr_t fp = mc.regs[29];
+#endif
+        size_t lo, hi;
+        get_stack_bounds(lo, hi);
+        // the thread may be running on a different stack, such as the signal stack
+        if (sp < lo || sp >= hi)
+            return 0;
+        unsigned n = 0;
+        while (true) {
+            frames[2*n]     = ip;
+            frames[2*n + 1] = sp;
+            n++;
+            /* A frame record consists of the caller's frame pointer followed by the return address. As
+               frames must be strictly increasing, this terminates. */
+            if (n == LEAN_CPU_PROFILER_MAX_NATIVE_FRAMES || fp < sp || fp % sizeof(uintptr_t) != 0 ||
+                fp + 2 * sizeof(uintptr_t) > hi)
+                return n;
+            uintptr_t const * record = reinterpret_cast<uintptr_t const *>(fp);
+            ip = record[1];
+            sp = fp + 2 * sizeof(uintptr_t);
+            fp = record[0];
+            if (ip == 0)
+                return n;
+        }
+    }
+
+    void record_sample(void * uctx) {
+        uintptr_t native[2 * LEAN_CPU_PROFILER_MAX_NATIVE_FRAMES];
+        unsigned num_native = walk_frames(uctx, native);
+        interp_frames * fs = g_interp_frames;
+        unsigned num_interp = fs ? std::min(fs->m_depth, static_cast<unsigned>(LEAN_CPU_PROFILER_MAX_INTERP_FRAMES)) : 0;
+        std::atomic_signal_fence(std::memory_order_acquire);
+        sample_buffer * b = m_current.load();
+        b->m_writers++;
+        size_t len = 1 + 2 * num_native + 2 * num_interp;
+        if (m_current.load() != b) {
+            // the collector is swapping the buffers
+            m_num_dropped++;
+        } else {
+            size_t off = b->m_used.load();
+            do {
+                if (off + len > LEAN_CPU_PROFILER_BUFFER_SIZE)
+                    break;
+            } while (!b->m_used.compare_exchange_weak(off, off + len));
+            if (off + len > LEAN_CPU_PROFILER_BUFFER_SIZE) {
+                m_num_dropped++;
+            } else {
+                uintptr_t * d = b->m_data + off;
+                *d++ = num_native | (num_interp << 16);
+                std::copy(native, native + 2 * num_native, d);
+                d += 2 * num_native;
+                for (unsigned i = 0; i < num_interp; i++) {
+                    *d++ = reinterpret_cast<uintptr_t>(fs->m_fns[i]);
+                    *d++ = fs->m_sps[i];
+                }
+            }
+        }
+        b->m_writers--;
+    }
+
+    /* Merge the native and interpreted frames of a sample by stack address: an interpreted frame
+       is called by the native frames above its stack address and calls the ones below. */
+    void add_sample(uintptr_t const * d, unsigned num_native, unsigned num_interp) {
+        stack_key k;
+        uintptr_t const * interp = d + 2 * num_native;
+        unsigned j = 0;
+        for (unsigned i = num_native; i-- > 0;) {
+            // the top of frame `i` is the stack pointer of its caller
+            uintptr_t top = i + 1 < num_native ? d[2*(i + 1) + 1] : UINTPTR_MAX;
+            while (j < num_interp && top <= interp[2*j + 1]) {
+                k.push_back(interp[2*j] | g_interp_frame_tag);
+                j++;
+            }
+            k.push_back(d[2*i]);
+        }
+        for (; j < num_interp; j++)
+            k.push_back(interp[2*j] | g_interp_frame_tag);
+        m_stacks[k]++;
+        m_num_samples++;
+    }
+
+    void collect(sample_buffer * b) {
+        while (b->m_writers.load() != 0) {}
+        size_t used = b->m_used.load();
+        size_t i = 0;
+        while (i < used) {
+            uintptr_t h = b->m_data[i];
+            unsigned num_native = h & 0xffff;
+            unsigned num_interp = h >> 16;
+            add_sample(b->m_data + i + 1, num_native, num_interp);
+            i += 1 + 2 * num_native + 2 * num_interp;
+        }
+        b->m_used = 0;
+    }
+
+    void swap_and_collect() {
+        sample_buffer * old = m_current.load();
+        m_current = old == m_buffers[0] ? m_buffers[1] : m_buffers[0];
+        collect(old);
+    }
+
+    void run_collector() {
+        unique_lock<mutex> lock(m_mutex);
+        while (!m_stop) {
+            m_cv.wait_for(lock, chrono::milliseconds(LEAN_CPU_PROFILER_COLLECT_INTERVAL));
+            swap_and_collect();
+        }
+    }
+
+    static void set_timer(unsigned frequency) {
+        itimerval t;
+        t.it_interval.tv_sec  = 0;
+        t.it_interval.tv_usec = frequency ? 1000000 / frequency : 0;
+        t.it_value = t.it_interval;
+        setitimer(ITIMER_PROF, &t, nullptr);
+    }
+
+    static std::string frame_name(uintptr_t f, bool leaf) {
+        if (f & g_interp_frame_tag)
+            return name(reinterpret_cast<object *>(f & ~g_interp_frame_tag), true).to_string() + " [interpreted]";
+        // return addresses point after the call instruction, which may be the start of the next function
+        void * ip = reinterpret_cast<void *>(leaf ? f : f - 1);
+        Dl_info info;
+        if (!dladdr(ip, &info))
+            return "[unknown]";
+        if (!info.dli_sname) {
+            std::string lib = info.dli_fname ? info.dli_fname : "unknown";
+            return "[" + lib.substr(lib.rfind('/') + 1) + "]";
+        }
+        if (optional<std::string> r = demangle_lean_symbol(info.dli_sname))
+            return *r;
+        int status;
+        if (char * r = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status)) {
+            std::string s(r);
+            free(r);
+            return s;
+        }
+        return info.dli_sname;
+    }
+
+    void write_profile() {
+        std::ofstream out(m_out_fn);
+        if (out.fail())
+            throw exception(sstream() << "failed to write CPU profile to '" << m_out_fn << "'");
+        std::unordered_map<uintptr_t, std::string> names;
+        // sort the output for reproducibility
+        std::map<std::string, uint64_t> lines;
+        for (auto const & p : m_stacks) {
+            std::string line;
+            for (size_t i = 0; i < p.first.size(); i++) {
+                uintptr_t f = p.first[i];
+                bool leaf = i + 1 == p.first.size();
+                auto it = names.find(f);
+                if (it == names.end()) {
+                    std::string n = frame_name(f, leaf);
+                    std::replace(n.begin(), n.end(), ';', ':');
+                    it = names.emplace(f, n).first;
+                }
+                if (i > 0)
+                    line += ';';
+                line += it->second;
+            }
+            lines[line] += p.second;
+        }
+        for (auto const & p : lines)
+            out << p.first << " " << p.second << "\n";
+        if (m_num_dropped > 0)
+            std::cerr << "CPU profiler: dropped " << m_num_dropped << " of " << m_num_samples + m_num_dropped << " samples\n";
+    }
+
+public:
+    cpu_profiler(std::string const & out_fn):m_out_fn(out_fn) {
+        m_buffers[0] = new sample_buffer();
+        m_buffers[1] = new sample_buffer();
+        m_current    = m_buffers[0];
+    }
+
+    ~cpu_profiler() {
+        delete m_buffers[0];
+        delete m_buffers[1];
+    }
+
+    void start(unsigned frequency) {
+        m_collector.reset(new lthread([this]() { save_stack_info(false); run_collector(); }));
+        struct sigaction action;
+        // run on the signal stack: the thread's stack may not be committed below the interrupted frame,
+        // see `enable_stack_growth`
+        action.sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+        action.sa_sigaction = [](int, siginfo_t *, void * uctx) {
+            int saved_errno = errno;
+            // announce the handler before reading `g_cpu_profiler`, see `stop`
+            g_num_handlers++;
+            if (cpu_profiler * p = g_cpu_profiler.load())
+                p->record_sample(uctx);
+            g_num_handlers--;
+            errno = saved_errno;
+        };
+        sigaction(SIGPROF, &action, &m_old_action);
+        set_timer(frequency);
+    }
+
+    /* Must be called after `g_cpu_profiler` has been reset. */
+    void stop() {
+        set_timer(0);
+        // signals may still be pending
+        struct sigaction ignore;
+        ignore.sa_flags   = 0;
+        ignore.sa_handler = SIG_IGN;
+        sigemptyset(&ignore.sa_mask);
+        sigaction(SIGPROF, &ignore, nullptr);
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_collector->join();
+        /* A handler that read `g_cpu_profiler` before it was reset may still be walking the stack without
+           having registered as a writer of a buffer yet. Since handlers increment `g_num_handlers`
+           before reading `g_cpu_profiler`, waiting for it to drop to zero ensures that no handler
+           can access the profiler anymore. */
+        while (g_num_handlers.load() != 0) {}
+        swap_and_collect();
+        swap_and_collect();
+        sigaction(SIGPROF, &m_old_action, nullptr);
+        write_profile();
+    }
+
+    static std::atomic<cpu_profiler *> g_cpu_profiler;
+    /* number of signal handlers currently running on any thread */
+    static std::atomic<unsigned>       g_num_handlers;
+};
+
+std::atomic<cpu_profiler *> cpu_profiler::g_cpu_profiler{nullptr};
+std::atomic<unsigned> cpu_profiler::g_num_handlers{0};
+
+void start_cpu_profiler(std::string const & out_fn, unsigned frequency) {
+    if (cpu_profiler::g_cpu_profiler)
+        throw exception("CPU profiler is already running");
+    cpu_profiler * p = new cpu_profiler(out_fn);
+    cpu_profiler::g_cpu_profiler = p;
+    g_cpu_profiler_enabled = true;
+    p->start(frequency);
+}
+
+void stop_cpu_profiler() {
+    std::unique_ptr<cpu_profiler> p(cpu_profiler::g_cpu_profiler.load());
+    if (!p)
+        return;
+    cpu_profiler::g_cpu_profiler = nullptr;
+    g_cpu_profiler_enabled = false;
+    p->stop();
+}
+#else
+void start_cpu_profiler(std::string const &, unsigned) {
+    throw exception("CPU profiler is not supported on this platform");
+}
+
+void stop_cpu_profiler() {}
+#endif
+
+scoped_cpu_profiler::scoped_cpu_profiler(optional<std::string> const & out_fn):m_active(static_cast<bool>(out_fn)) {
+    if (m_active)
+        start_cpu_profiler(*out_fn);
+}
+
+scoped_cpu_profiler::~scoped_cpu_profiler() {
+    if (m_active) {
+        try {
+            stop_cpu_profiler();
+        } catch (exception & ex) {
+            std::cerr << ex.what() << "\n";
+        }
+    }
+}
+
+void initialize_cpu_profiler() {
+    g_pinned_names_mutex = new mutex();
+    g_pinned_names       = new std::vector<object *>();
+}
+
+void finalize_cpu_profiler() {
+    for (object * o : *g_pinned_names)
+        dec(o);
+    delete g_pinned_names;
+    delete g_pinned_names_mutex;
+}
+}
@@ -0,0 +1,45 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <string>
+#include "util/name.h"
+
+namespace lean {
+/* Sampling CPU profiler (`lean --profile-cpu=file`).
+
+   `SIGPROF` is delivered to the thread consuming CPU time at the requested frequency, and its
+   handler walks the frame pointer chain of the native stack into a preallocated buffer that a
+   collector thread aggregates. Native stacks are only complete in builds with frame pointers
+   (`-fno-omit-frame-pointer`, as in `RelWithDebInfo`); elsewhere they are truncated.
+   Frames of the IR interpreter are reported by the interpreter itself (see
+   `cpu_profiler_set_interp_frame`) and merged into the native stacks by stack address, so
+   interpreted declarations show up as their own frames. Native frames are named using the dynamic
+   symbol table, with Lean and C++ symbols demangled. The result is written in the collapsed stack
+   format (`frame;frame;...;frame count` per line) understood by `flamegraph.pl` and speedscope.
+
+   Only supported on x86-64 and AArch64 Linux; elsewhere, `start_cpu_profiler` reports an error. */
+void start_cpu_profiler(std::string const & out_fn, unsigned frequency = 1000);
+/* Stop sampling and write the profile. Does nothing if the profiler is not running. */
+void stop_cpu_profiler();
+
+class scoped_cpu_profiler {
+    bool m_active;
+public:
+    scoped_cpu_profiler(optional<std::string> const & out_fn);
+    ~scoped_cpu_profiler();
+};
+
+extern bool g_cpu_profiler_enabled;
+
+/* Interpreter hooks: frame `i`, counting from the outermost one, of the interpreted call stack of the
+   current thread is now `fn`, evaluated by the native frame at stack address `sp`. It is the innermost frame. */
+void cpu_profiler_set_interp_frame(unsigned i, name const & fn, void * sp);
+/* The interpreted call stack of the current thread now consists of `depth` frames. */
+void cpu_profiler_set_interp_depth(unsigned depth);
+unsigned cpu_profiler_get_interp_depth();
+
+void initialize_cpu_profiler();
+void finalize_cpu_profiler();
+}
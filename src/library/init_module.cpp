@@ -12,6 +12,7 @@ Author: Leonardo de Moura
 #include "library/util.h"
 #include "library/profiling.h"
 #include "library/time_task.h"
+#include "library/cpu_profiler.h"
 #include "library/formatter.h"
 
 namespace lean {
@@ -34,9 +35,11 @@ void initialize_library_module() {
     initialize_class();
     initialize_library_util();
     initialize_time_task();
+    initialize_cpu_profiler();
 }
 
 void finalize_library_module() {
+    finalize_cpu_profiler();
     finalize_time_task();
     finalize_library_util();
     finalize_class();
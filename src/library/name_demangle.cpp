@@ -0,0 +1,149 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <cctype>
+#include <cstring>
+#include <string>
+#include "runtime/utf8.h"
+#include "library/name_demangle.h"
+
+namespace lean {
+static bool is_digit(char c) {
+    return '0' <= c && c <= '9';
+}
+
+static bool is_alnum(char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || is_digit(c);
+}
+
+static bool parse_hex(char const * s, unsigned n, unsigned & r) {
+    r = 0;
+    for (unsigned i = 0; i < n; i++) {
+        char c = s[i];
+        r *= 16;
+        if (is_digit(c))
+            r += c - '0';
+        else if ('a' <= c && c <= 'f')
+            r += c - 'a' + 10;
+        else
+            return false;
+    }
+    return true;
+}
+
+static unsigned underscore_run(char const * s) {
+    unsigned k = 0;
+    while (s[k] == '_') k++;
+    return k;
+}
+
+/* Parse the components of a name mangled by `Lean.Name.mangleAux`, appending them to `out` separated by dots. */
+static bool demangle_name(char const * s, std::string & out) {
+    if (!*s)
+        return false;
+    bool first = true;
+    while (true) {
+        if (!first)
+            out += '.';
+        first = false;
+        /* numeric component `<digits>_`, followed by the end of the symbol or by a separator */
+        if (is_digit(*s)) {
+            unsigned j = 0;
+            while (is_digit(s[j])) j++;
+            unsigned k = underscore_run(s + j);
+            if ((k == 1 && s[j + 1] == 0) || (k >= 2 && k % 2 == 0)) {
+                out.append(s, j);
+                s += j + 1;
+                if (!*s)
+                    return true;
+                s++; // separator
+                continue;
+            }
+        }
+        bool empty = true;
+        while (true) {
+            char c = *s;
+            if (c == 0) {
+                return !empty;
+            } else if (is_alnum(c)) {
+                out += c;
+                s++;
+                empty = false;
+            } else if (c == '_') {
+                unsigned k = underscore_run(s);
+                char const * next = s + k;
+                unsigned code;
+                bool escape = (*next == 'x' && parse_hex(next + 1, 2, code)) ||
+                    (*next == 'u' && parse_hex(next + 1, 4, code)) ||
+                    (*next == 'U' && parse_hex(next + 1, 8, code));
+                if (escape && k % 2 == 1) {
+                    out.append(k / 2, '_');
+                    push_unicode_scalar(out, code);
+                    s = next + 1 + (*next == 'x' ? 2 : *next == 'u' ? 4 : 8);
+                } else if (k % 2 == 0 && !(escape && !empty)) {
+                    out.append(k / 2, '_');
+                    s = next;
+                } else {
+                    // separator; the remaining underscores belong to the next component
+                    if (empty || *next == 0)
+                        return false;
+                    s++;
+                    break;
+                }
+                empty = false;
+            } else {
+                return false;
+            }
+        }
+    }
+}
+
+optional<std::string> demangle_lean_symbol(char const * sym) {
+    std::string r;
+    if (strncmp(sym, "_init_", 6) == 0) {
+        r = "[init] ";
+        sym += 6;
+    }
+    if (strncmp(sym, "l_", 2) == 0) {
+        sym += 2;
+    } else if (r.empty() && strncmp(sym, "initialize_", 11) == 0) {
+        r = "[init] module ";
+        sym += 11;
+    } else {
+        return optional<std::string>();
+    }
+    if (!demangle_name(sym, r))
+        return optional<std::string>();
+    return optional<std::string>(r);
+}
+
+static bool is_symbol_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+void demangle_lean_symbols(std::istream & in, std::ostream & out) {
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t i = 0;
+        while (i < line.size()) {
+            if (!is_symbol_char(line[i])) {
+                out << line[i++];
+                continue;
+            }
+            size_t j = i;
+            while (j < line.size() && is_symbol_char(line[j]))
+                j++;
+            std::string word = line.substr(i, j - i);
+            if (optional<std::string> n = demangle_lean_symbol(word.c_str()))
+                out << *n;
+            else
+                out << word;
+            i = j;
+        }
+        if (!in.eof())
+            out << '\n';
+        out.flush();
+    }
+}
+}
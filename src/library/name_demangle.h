@@ -0,0 +1,24 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <iostream>
+#include <string>
+#include "runtime/optional.h"
+
+namespace lean {
+/* Inverse of `Lean.Name.mangle`: turn a C symbol produced by the code generator, such as
+   `l_Lean_Meta_whnf___rarg`, back into a readable declaration name (`Lean.Meta.whnf._rarg`).
+   Symbols of the initialization code are prefixed with `[init] `, e.g. `_init_l_Foo_x` is shown
+   as `[init] Foo.x` and `initialize_Init_Data` as `[init] module Init.Data`.
+   Returns `none` if `sym` is not the mangled form of a Lean name.
+
+   Mangling is not injective. When in doubt, a run of underscores is read as a component
+   separator followed by components starting with `_`, as produced by auxiliary declarations. */
+optional<std::string> demangle_lean_symbol(char const * sym);
+
+/* Copy `in` to `out`, replacing each word (maximal sequence of ASCII letters, digits and `_`)
+   that `demangle_lean_symbol` accepts by its demangling, similar to `c++filt`. */
+void demangle_lean_symbols(std::istream & in, std::ostream & out);
+}
@@ -442,6 +442,13 @@ void dealloc(void * o, size_t sz) {
     dealloc_small_core(o);
 }
 
+void export_thread_heap_objs() {
+    if (g_heap && g_heap->m_to_export_list) {
+        LEAN_RUNTIME_STAT_CODE(g_num_exports++);
+        g_heap->export_objs();
+    }
+}
+
 extern "C" LEAN_EXPORT void lean_free_small(void * o) {
     dealloc_small_core(o);
 }
@@ -463,6 +470,11 @@ void initialize_alloc() {
 void finalize_alloc() {
 }
 
+#ifndef LEAN_SMALL_ALLOCATOR
+void export_thread_heap_objs() {
+}
+#endif
+
 #ifndef LEAN_SMALL_ALLOCATOR
 LEAN_THREAD_VALUE(uint64_t, g_heartbeat, 0);
 #endif
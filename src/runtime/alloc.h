@@ -12,6 +12,8 @@ namespace lean {
 void init_thread_heap();
 void * alloc(size_t sz);
 void dealloc(void * o, size_t sz);
+/* Send the objects deallocated by this thread but owned by other heaps back to their heaps. */
+void export_thread_heap_objs();
 void add_heartbeats(uint64_t count);
 uint64_t get_num_heartbeats();
 void initialize_alloc();
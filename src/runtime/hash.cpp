@@ -4,10 +4,12 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <cstring>
 #include "runtime/hash.h"
 
 namespace lean {
 
+#if LEAN_STRING_HASH_VERSION < 2
 //-----------------------------------------------------------------------------
 // MurmurHash2, 64-bit versions, by Austin Appleby
 // https://sites.google.com/site/murmurhash/
@@ -50,9 +52,99 @@ static uint64 MurmurHash64A(void const * key, size_t len, uint64 seed) {
 
     return h;
 }
+#else
+//-----------------------------------------------------------------------------
+// wyhash-style hash: 64x64->128 bit multiply-and-fold mixing, processing 48 bytes per
+// iteration using three independent lanes.
+// https://github.com/wangyi-fudan/wyhash
+static inline void wy_mum(uint64 & a, uint64 & b) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+    a = static_cast<uint64>(r);
+    b = static_cast<uint64>(r >> 64);
+#else
+    uint64 ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+    uint64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32);
+    uint64 c = t < rl;
+    uint64 lo = t + (rm1 << 32);
+    c += lo < t;
+    a = lo;
+    b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64 wy_mix(uint64 a, uint64 b) {
+    wy_mum(a, b);
+    return a ^ b;
+}
+
+static inline uint64 wy_r8(unsigned char const * p) {
+    uint64 v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64 wy_r4(unsigned char const * p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64 wy_r3(unsigned char const * p, size_t k) {
+    return (static_cast<uint64>(p[0]) << 16) | (static_cast<uint64>(p[k >> 1]) << 8) | p[k - 1];
+}
+
+static uint64 wyhash(unsigned char const * p, size_t len, uint64 seed) {
+    const uint64 s0 = 0xa0761d6478bd642f;
+    const uint64 s1 = 0xe7037ed1a0b428db;
+    const uint64 s2 = 0x8ebc6af09c88c6e3;
+    const uint64 s3 = 0x589965cc75374cc3;
+    seed ^= wy_mix(seed ^ s0, s1);
+    uint64 a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wy_r4(p) << 32) | wy_r4(p + ((len >> 3) << 2));
+            b = (wy_r4(p + len - 4) << 32) | wy_r4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = wy_r3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64 see1 = seed, see2 = seed;
+            do {
+                seed = wy_mix(wy_r8(p) ^ s1, wy_r8(p + 8) ^ seed);
+                see1 = wy_mix(wy_r8(p + 16) ^ s2, wy_r8(p + 24) ^ see1);
+                see2 = wy_mix(wy_r8(p + 32) ^ s3, wy_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wy_mix(wy_r8(p) ^ s1, wy_r8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wy_r8(p + i - 16);
+        b = wy_r8(p + i - 8);
+    }
+    a ^= s1;
+    b ^= seed;
+    wy_mum(a, b);
+    return wy_mix(a ^ s0 ^ len, b ^ s1);
+}
+#endif
 
 uint64 hash_str(size_t len, unsigned char const * str, uint64 init_value) {
+#if LEAN_STRING_HASH_VERSION >= 2
+    return wyhash(str, len, init_value);
+#else
     return MurmurHash64A(str, len, init_value);
+#endif
 }
 
 }
@@ -8,6 +8,14 @@ Author: Leonardo de Moura
 #include "runtime/debug.h"
 #include "runtime/int64.h"
 
+/* Version of the string hash function used by `hash_str`. Hashes of names are stored in .olean files,
+   and `Hashable` instances must be deterministic, so changing the version changes the .olean format.
+   1: MurmurHash64A
+   2: wyhash */
+#ifndef LEAN_STRING_HASH_VERSION
+#define LEAN_STRING_HASH_VERSION 1
+#endif
+
 namespace lean {
 
 uint64 hash_str(size_t len, unsigned char const * str, uint64 init_value);
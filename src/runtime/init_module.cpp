@@ -12,6 +12,7 @@ Author: Leonardo de Moura
 #include "runtime/stack_overflow.h"
 #include "runtime/process.h"
 #include "runtime/mutex.h"
+#include "runtime/task_trace.h"
 #include "runtime/init_module.h"
 
 namespace lean {
@@ -19,6 +20,7 @@ extern "C" LEAN_EXPORT void lean_initialize_runtime_module() {
     initialize_alloc();
     initialize_debug();
     initialize_object();
+    initialize_task_trace();
     initialize_io();
     initialize_thread();
     initialize_mutex();
@@ -34,6 +36,7 @@ void finalize_runtime_module() {
     finalize_mutex();
     finalize_thread();
     finalize_io();
+    finalize_task_trace();
     finalize_object();
     finalize_debug();
     finalize_alloc();
@@ -27,6 +27,14 @@ Authors: Leonardo de Moura, Sebastian Ullrich
 #endif
 #ifndef LEAN_WINDOWS
 #include <csignal>
+#include <sys/mman.h>
+#endif
+#if defined(__linux__)
+// The reactor needs `epoll`
+#define LEAN_IO_REACTOR
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #endif
 #include <dirent.h>
 #include <fcntl.h>
@@ -38,6 +46,9 @@ Authors: Leonardo de Moura, Sebastian Ullrich
 #include <string>
 #include <cstdlib>
 #include <cctype>
+#include <memory>
+#include <functional>
+#include <vector>
 #include <sys/stat.h>
 #include "util/io.h"
 #include "runtime/alloc.h"
@@ -46,6 +57,7 @@ Authors: Leonardo de Moura, Sebastian Ullrich
 #include "runtime/object.h"
 #include "runtime/thread.h"
 #include "runtime/allocprof.h"
+#include "runtime/stackinfo.h"
 
 #ifdef _MSC_VER
 #define S_ISDIR(mode) ((mode & _S_IFDIR) != 0)
@@ -307,6 +319,7 @@ static inline HANDLE win_handle(FILE * fp) {
 
 /* Handle.lock : (@& Handle) → (exclusive : Bool) → IO Unit */
 extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_lock(b_obj_arg h, uint8_t x, obj_arg /* w */) {
+    flush_deferred_dec();
     OVERLAPPED o = {0};
     HANDLE wh = win_handle(io_get_handle(h));
     DWORD flags = x ? LOCKFILE_EXCLUSIVE_LOCK : 0;
@@ -353,6 +366,7 @@ extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_unlock(b_obj_arg h, obj_arg /
 
 /* Handle.lock : (@& Handle) → (exclusive : Bool) → IO Unit */
 extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_lock(b_obj_arg h,  uint8_t x, obj_arg /* w */) {
+    flush_deferred_dec();
     FILE * fp = io_get_handle(h);
     if (!flock(fileno(fp), x ? LOCK_EX : LOCK_SH)) {
         return io_result_mk_ok(box(0));
@@ -458,6 +472,20 @@ extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_truncate(b_obj_arg h, obj_arg
 /* Handle.read : (@& Handle) → USize → IO ByteArray */
 extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_read(b_obj_arg h, usize nbytes, obj_arg /* w */) {
     FILE * fp = io_get_handle(h);
+    /* Reading may block until another thread or process writes to the stream, which may be waiting for
+       us to release objects, e.g. the other end of a pipe. */
+    flush_deferred_dec();
+    /* Peek at the stream before allocating a buffer of `nbytes` that may stay empty. */
+    int c = std::getc(fp);
+    if (c == EOF) {
+        if (std::feof(fp)) {
+            clearerr(fp);
+            return io_result_mk_ok(lean_alloc_sarray(1, 0, 0));
+        } else {
+            return io_result_mk_error(decode_io_error(errno, nullptr));
+        }
+    }
+    std::ungetc(c, fp);
     obj_res res = lean_alloc_sarray(1, 0, nbytes);
     usize n = std::fread(lean_sarray_cptr(res), 1, nbytes, fp);
     if (n > 0) {
@@ -485,6 +513,54 @@ extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_write(b_obj_arg h, b_obj_arg
     }
 }
 
+/* Buffer for reading lines, reused by all reads of a thread. */
+struct line_buffer {
+    char * m_data{nullptr};
+    size_t m_capacity{0};
+    ~line_buffer() { free(m_data); }
+};
+
+MK_THREAD_LOCAL_GET_DEF(line_buffer, get_line_buffer);
+
+/* Buffers grown beyond this size by a long line are released after use instead of being kept by the thread. */
+#define LEAN_MAX_RETAINED_LINE_BUFFER (64*1024)
+
+struct line_buffer_trimmer {
+    line_buffer & m_buffer;
+    ~line_buffer_trimmer() {
+        if (m_buffer.m_capacity > LEAN_MAX_RETAINED_LINE_BUFFER) {
+            free(m_buffer.m_data);
+            m_buffer.m_data     = nullptr;
+            m_buffer.m_capacity = 0;
+        }
+    }
+};
+
+/* Read bytes up to (including) `delim` into `b`, scanning the stream buffer directly.
+   Return the number of bytes read, or -1 at end-of-file or on error. */
+static long read_delim(FILE * fp, int delim, line_buffer & b) {
+#if defined(LEAN_WINDOWS)
+    size_t n = 0;
+    int c;
+    _lock_file(fp);
+    while ((c = _getc_nolock(fp)) != EOF) {
+        if (n == b.m_capacity) {
+            size_t new_capacity = b.m_capacity == 0 ? 128 : 2 * b.m_capacity;
+            char * new_data = static_cast<char *>(realloc(b.m_data, new_capacity));
+            if (new_data == nullptr) lean_internal_panic_out_of_memory();
+            b.m_data     = new_data;
+            b.m_capacity = new_capacity;
+        }
+        b.m_data[n++] = static_cast<char>(c);
+        if (c == delim) break;
+    }
+    _unlock_file(fp);
+    return n == 0 ? -1 : static_cast<long>(n);
+#else
+    return getdelim(&b.m_data, &b.m_capacity, delim, fp);
+#endif
+}
+
 /*
   Handle.getLine : (@& Handle) → IO Unit
   The line returned by `lean_io_prim_handle_get_line`
@@ -492,29 +568,76 @@ extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_write(b_obj_arg h, b_obj_arg
   rest of the line is discarded. */
 extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_get_line(b_obj_arg h, obj_arg /* w */) {
     FILE * fp = io_get_handle(h);
-    const int buf_sz = 64;
-    char buf_str[buf_sz]; // NOLINT
-    std::string result;
-    bool first = true;
+    /* See `lean_io_prim_handle_read` */
+    flush_deferred_dec();
+    line_buffer & b = get_line_buffer();
+    line_buffer_trimmer trim{b};
+    long n = read_delim(fp, '\n', b);
+    if (n >= 0) {
+        size_t sz = static_cast<size_t>(n);
+        if (char const * nul = static_cast<char const *>(memchr(b.m_data, 0, sz)))
+            sz = nul - b.m_data;
+        return io_result_mk_ok(lean_mk_string_from_bytes(b.m_data, sz));
+    } else if (std::feof(fp)) {
+        clearerr(fp);
+        return io_result_mk_ok(mk_string(""));
+    } else {
+        return io_result_mk_error(decode_io_error(errno, nullptr));
+    }
+}
+
+/* Handle.readUntil : (@& Handle) → UInt8 → IO ByteArray */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_read_until(b_obj_arg h, uint8 delim, obj_arg /* w */) {
+    FILE * fp = io_get_handle(h);
+    /* See `lean_io_prim_handle_read` */
+    flush_deferred_dec();
+    line_buffer & b = get_line_buffer();
+    line_buffer_trimmer trim{b};
+    long n = read_delim(fp, delim, b);
+    if (n >= 0) {
+        obj_res r = lean_alloc_sarray(1, n, n);
+        memcpy(lean_sarray_cptr(r), b.m_data, n);
+        return io_result_mk_ok(r);
+    } else if (std::feof(fp)) {
+        clearerr(fp);
+        return io_result_mk_ok(lean_alloc_sarray(1, 0, 0));
+    } else {
+        return io_result_mk_error(decode_io_error(errno, nullptr));
+    }
+}
+
+/*
+  Handle.readLines : (@& Handle) → IO (Array String)
+  Read all remaining lines, without their line terminators.
+  As in `lean_io_prim_handle_get_line`, lines are truncated at the first '\0' character. */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_read_lines(b_obj_arg h, obj_arg /* w */) {
+    FILE * fp = io_get_handle(h);
+    /* See `lean_io_prim_handle_read` */
+    flush_deferred_dec();
+    line_buffer & b = get_line_buffer();
+    line_buffer_trimmer trim{b};
+    object * lines = lean_mk_empty_array();
     while (true) {
-        char * out = std::fgets(buf_str, buf_sz, fp);
-        if (out != nullptr) {
-            if (strlen(buf_str) < buf_sz-1 || buf_str[buf_sz-2] == '\n') {
-                if (first) {
-                    return io_result_mk_ok(mk_string(out));
-                } else {
-                    result.append(out);
-                    return io_result_mk_ok(mk_string(result));
-                }
+        long n = read_delim(fp, '\n', b);
+        if (n < 0) {
+            if (std::feof(fp)) {
+                clearerr(fp);
+                return io_result_mk_ok(lines);
+            } else {
+                dec_ref(lines);
+                return io_result_mk_error(decode_io_error(errno, nullptr));
             }
-            result.append(out);
-        } else if (std::feof(fp)) {
-            clearerr(fp);
-            return io_result_mk_ok(mk_string(result));
-        } else {
-            return io_result_mk_error(decode_io_error(errno, nullptr));
         }
-        first = false;
+        size_t sz = static_cast<size_t>(n);
+        if (sz > 0 && b.m_data[sz - 1] == '\n') {
+            sz--;
+#if defined(LEAN_WINDOWS)
+            if (sz > 0 && b.m_data[sz - 1] == '\r') sz--;
+#endif
+        }
+        if (char const * nul = static_cast<char const *>(memchr(b.m_data, 0, sz)))
+            sz = nul - b.m_data;
+        lines = lean_array_push(lines, lean_mk_string_from_bytes(b.m_data, sz));
     }
 }
 
@@ -843,6 +966,80 @@ extern "C" LEAN_EXPORT obj_res lean_io_remove_file(b_obj_arg fname, obj_arg) {
     }
 }
 
+/* Read the whole file `fname` into a new scalar array. */
+static obj_res read_file_into_sarray(b_obj_arg fname) {
+    FILE * fp = std::fopen(string_cstr(fname), "rb");
+    if (!fp)
+        return io_result_mk_error(decode_io_error(errno, fname));
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0) {
+        int e = errno;
+        std::fclose(fp);
+        return io_result_mk_error(decode_io_error(e, fname));
+    }
+    usize size = st.st_size;
+    obj_res r = lean_alloc_sarray(1, 0, size);
+    usize n = std::fread(lean_sarray_cptr(r), 1, size, fp);
+    std::fclose(fp);
+    lean_sarray_set_size(r, n);
+    return io_result_mk_ok(r);
+}
+
+#if !defined(LEAN_WINDOWS) && !defined(LEAN_EMSCRIPTEN)
+static void unmap_file(void * base, size_t size) {
+    munmap(base, size);
+}
+#endif
+
+/*
+  mmapFile : (@& FilePath) → IO ByteArray
+  The file is mapped privately right after a header page, so that the mapping is the data of
+  a scalar array whose header lives at the end of that page. The array is registered as a foreign
+  scalar array, and the mapping is released when the array is deleted. Writes to the array
+  (e.g., by in-place updates when it is not shared) only affect the private copy of the pages.
+  Small files, which would waste most of the header page, are read instead. */
+extern "C" LEAN_EXPORT obj_res lean_io_mmap_file(b_obj_arg fname, obj_arg) {
+#if defined(LEAN_WINDOWS) || defined(LEAN_EMSCRIPTEN)
+    /* No mapping support, read the file instead. */
+    return read_file_into_sarray(fname);
+#else
+    int fd = open(string_cstr(fname), O_RDONLY);
+    if (fd == -1)
+        return io_result_mk_error(decode_io_error(errno, fname));
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int e = errno;
+        close(fd);
+        return io_result_mk_error(decode_io_error(e, fname));
+    }
+    usize size = st.st_size;
+    usize page_size = sysconf(_SC_PAGESIZE);
+    if (size < page_size) {
+        close(fd);
+        return read_file_into_sarray(fname);
+    }
+    char * base = static_cast<char *>(mmap(nullptr, page_size + size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (base == MAP_FAILED) {
+        int e = errno;
+        close(fd);
+        return io_result_mk_error(decode_io_error(e, fname));
+    }
+    if (mmap(base + page_size, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        int e = errno;
+        munmap(base, page_size + size);
+        close(fd);
+        return io_result_mk_error(decode_io_error(e, fname));
+    }
+    close(fd);
+    lean_object * o = reinterpret_cast<lean_object *>(base + page_size - sizeof(lean_sarray_object));
+    lean_set_st_header(o, LeanScalarArray, 1);
+    lean_to_sarray(o)->m_size     = size;
+    lean_to_sarray(o)->m_capacity = size;
+    register_foreign_sarray(o, unmap_file, base, page_size + size);
+    return io_result_mk_ok(o);
+#endif
+}
+
 extern "C" LEAN_EXPORT obj_res lean_io_app_path(obj_arg) {
 #if defined(LEAN_WINDOWS)
     HMODULE hModule = GetModuleHandle(NULL);
@@ -919,8 +1116,182 @@ extern "C" LEAN_EXPORT obj_res lean_st_mk_ref(obj_arg a, obj_arg) {
 
 static object * g_io_error_nullptr_read = nullptr;
 
-static inline atomic<object*> * mt_ref_val_addr(object * o) {
-    return reinterpret_cast<atomic<object*> *>(&(lean_to_ref(o)->m_value));
+/*
+  Multi-threaded refs are read and written without locks. A reader must increment the RC of
+  the value it loaded before a concurrent `set` releases the last owning reference to it. So
+  readers first announce the value in a per-thread hazard pointer and check that the ref still
+  contains it, and writers only release old values that no thread has announced. Values that
+  are still announced are retired and released by a later write of the same thread, or when
+  the thread finishes. `take` and `swap` hand the old value to their caller instead, so they wait
+  until no reader announces it anymore.
+
+  A ref is empty while a `take` is pending (e.g., in `Ref.modify`). Threads that find the ref
+  empty block on the condition variable of a slot selected by the address of the ref until the
+  value is put back. Writers only take the lock of the slot if there are waiters.
+*/
+struct mt_ref_hazard {
+    atomic<object *>  m_ptr{nullptr};
+    atomic<bool>      m_in_use{true};
+    mt_ref_hazard *   m_next{nullptr};
+};
+
+static atomic<mt_ref_hazard *> g_mt_ref_hazards{nullptr};
+LEAN_THREAD_PTR(mt_ref_hazard, g_mt_ref_hazard);
+LEAN_THREAD_PTR(std::vector<object *>, g_mt_ref_retired);
+
+static bool mt_ref_is_hazard(object * o) {
+    for (mt_ref_hazard * h = g_mt_ref_hazards.load(); h; h = h->m_next) {
+        if (h->m_ptr.load() == o)
+            return true;
+    }
+    return false;
+}
+
+/* Release all retired values that are not announced anymore. */
+static void mt_ref_reclaim() {
+    std::vector<object *> retired;
+    retired.swap(*g_mt_ref_retired);
+    for (object * o : retired) {
+        if (mt_ref_is_hazard(o))
+            g_mt_ref_retired->push_back(o);
+        else
+            dec(o); // may retire further values
+    }
+}
+
+static void finalize_mt_ref_hazard(void *) {
+    while (!g_mt_ref_retired->empty()) {
+        mt_ref_reclaim();
+        if (!g_mt_ref_retired->empty())
+            this_thread::yield();
+    }
+    delete g_mt_ref_retired;
+    g_mt_ref_retired = nullptr;
+    g_mt_ref_hazard->m_in_use.store(false, std::memory_order_release);
+    g_mt_ref_hazard = nullptr;
+}
+
+static mt_ref_hazard * get_mt_ref_hazard() {
+    if (g_mt_ref_hazard)
+        return g_mt_ref_hazard;
+    mt_ref_hazard * h = g_mt_ref_hazards.load();
+    for (; h; h = h->m_next) {
+        bool in_use = false;
+        if (!h->m_in_use.load(std::memory_order_relaxed) && h->m_in_use.compare_exchange_strong(in_use, true))
+            break;
+    }
+    if (!h) {
+        /* Hazard records are never removed from the list, only reused by later threads. */
+        h = new mt_ref_hazard();
+        mt_ref_hazard * head = g_mt_ref_hazards.load();
+        do {
+            h->m_next = head;
+        } while (!g_mt_ref_hazards.compare_exchange_weak(head, h));
+    }
+    g_mt_ref_hazard  = h;
+    g_mt_ref_retired = new std::vector<object *>();
+    register_thread_finalizer(finalize_mt_ref_hazard, nullptr);
+    return h;
+}
+
+/* Release the reference to `o` that was owned by a multi-threaded ref. */
+static void mt_ref_release(object * o) {
+    if (lean_is_scalar(o) || lean_is_persistent(o))
+        return;
+    get_mt_ref_hazard();
+    if (mt_ref_is_hazard(o)) {
+        g_mt_ref_retired->push_back(o);
+    } else {
+        dec(o);
+    }
+    if (!g_mt_ref_retired->empty())
+        mt_ref_reclaim();
+}
+
+/* Wait until no thread announces `o`, which was just removed from a multi-threaded ref, so that the
+   reference owned by the ref can be passed on. Readers announce a value only until they have checked
+   that the ref still contains it, so this does not take long. */
+static void mt_ref_wait_unannounced(object * o) {
+    if (lean_is_scalar(o) || lean_is_persistent(o))
+        return;
+    while (mt_ref_is_hazard(o))
+        this_thread::yield();
+}
+
+struct mt_ref_slot {
+    mutex              m_mutex;
+    condition_variable m_cv;
+    atomic<unsigned>   m_num_waiters{0};
+};
+
+#define LEAN_NUM_MT_REF_SLOTS 64
+static mt_ref_slot * g_mt_ref_slots = nullptr;
+
+static inline mt_ref_slot & get_mt_ref_slot(b_obj_arg ref) {
+    return g_mt_ref_slots[(reinterpret_cast<size_t>(ref) / sizeof(lean_ref_object)) % LEAN_NUM_MT_REF_SLOTS];
+}
+
+static_assert(sizeof(atomic<object *>) == sizeof(object *), "`atomic<object *>` and `object *` must have the same size"); // NOLINT
+
+static inline atomic<object *> * mt_ref_val_addr(b_obj_arg ref) {
+    return reinterpret_cast<atomic<object *> *>(&(lean_to_ref(ref)->m_value));
+}
+
+/* Wait until `ref` is not empty. */
+static void mt_ref_wait(b_obj_arg ref) {
+    flush_deferred_dec();
+    mt_ref_slot & slot = get_mt_ref_slot(ref);
+    unique_lock<mutex> lock(slot.m_mutex);
+    slot.m_num_waiters++;
+    while (mt_ref_val_addr(ref)->load() == nullptr)
+        slot.m_cv.wait(lock);
+    slot.m_num_waiters--;
+}
+
+/* Wake up threads waiting for `ref` to be non-empty. */
+static void mt_ref_notify(b_obj_arg ref) {
+    mt_ref_slot & slot = get_mt_ref_slot(ref);
+    if (slot.m_num_waiters.load() > 0) {
+        unique_lock<mutex> lock(slot.m_mutex);
+        slot.m_cv.notify_all();
+    }
+}
+
+/* Return an owned reference to the value of the multi-threaded ref `ref`. */
+static object * mt_ref_get(b_obj_arg ref) {
+    atomic<object *> * val_addr = mt_ref_val_addr(ref);
+    mt_ref_hazard * h = nullptr;
+    while (true) {
+        object * val = val_addr->load();
+        if (val == nullptr) {
+            mt_ref_wait(ref);
+            continue;
+        }
+        if (lean_is_scalar(val))
+            return val;
+        if (!h)
+            h = get_mt_ref_hazard();
+        h->m_ptr.store(val);
+        if (val_addr->load() == val) {
+            inc(val);
+            h->m_ptr.store(nullptr, std::memory_order_release);
+            return val;
+        }
+        // do not keep announcing a value while blocked, see `mt_ref_wait_unannounced`
+        h->m_ptr.store(nullptr, std::memory_order_release);
+    }
+}
+
+static void mt_ref_set(b_obj_arg ref, obj_arg a) {
+    /* We must mark `a` as multi-threaded if `ref` is marked as multi-threaded.
+       Reason: our runtime relies on the fact that a single-threaded object
+       cannot be reached from a multi-thread object. */
+    mark_mt(a);
+    object * old_a = mt_ref_val_addr(ref)->exchange(a);
+    if (old_a == nullptr)
+        mt_ref_notify(ref);
+    else
+        mt_ref_release(old_a);
 }
 
 /*
@@ -938,23 +1309,7 @@ static inline bool ref_maybe_mt(b_obj_arg ref) { return lean_is_mt(ref) || lean_
 
 extern "C" LEAN_EXPORT obj_res lean_st_ref_get(b_obj_arg ref, obj_arg) {
     if (ref_maybe_mt(ref)) {
-        atomic<object *> * val_addr = mt_ref_val_addr(ref);
-        while (true) {
-            /*
-              We cannot simply read `val` from the ref and `inc` it like in the `else` branch since someone else could
-              write to the ref in between and remove the last owning reference to the object. Instead, we must take
-              ownership of the RC token in the ref via `exchange`, duplicate it, then put one RC token back. */
-            object * val = val_addr->exchange(nullptr);
-            if (val != nullptr) {
-                inc(val);
-                object * tmp = val_addr->exchange(val);
-                if (tmp != nullptr) {
-                    /* this may happen if another thread wrote `ref` */
-                    dec(tmp);
-                }
-                return io_result_mk_ok(val);
-            }
-        }
+        return io_result_mk_ok(mt_ref_get(ref));
     } else {
         object * val = lean_to_ref(ref)->m_value;
         lean_assert(val != nullptr);
@@ -965,11 +1320,13 @@ extern "C" LEAN_EXPORT obj_res lean_st_ref_get(b_obj_arg ref, obj_arg) {
 
 extern "C" LEAN_EXPORT obj_res lean_st_ref_take(b_obj_arg ref, obj_arg) {
     if (ref_maybe_mt(ref)) {
-        atomic<object *> * val_addr = mt_ref_val_addr(ref);
         while (true) {
-            object * val = val_addr->exchange(nullptr);
-            if (val != nullptr)
+            object * val = mt_ref_val_addr(ref)->exchange(nullptr);
+            if (val != nullptr) {
+                mt_ref_wait_unannounced(val);
                 return io_result_mk_ok(val);
+            }
+            mt_ref_wait(ref);
         }
     } else {
         object * val = lean_to_ref(ref)->m_value;
@@ -983,14 +1340,7 @@ static_assert(sizeof(atomic<unsigned short>) == sizeof(unsigned short), "`atomic
 
 extern "C" LEAN_EXPORT obj_res lean_st_ref_set(b_obj_arg ref, obj_arg a, obj_arg) {
     if (ref_maybe_mt(ref)) {
-        /* We must mark `a` as multi-threaded if `ref` is marked as multi-threaded.
-           Reason: our runtime relies on the fact that a single-threaded object
-           cannot be reached from a multi-thread object. */
-        mark_mt(a);
-        atomic<object *> * val_addr = mt_ref_val_addr(ref);
-        object * old_a = val_addr->exchange(a);
-        if (old_a != nullptr)
-            dec(old_a);
+        mt_ref_set(ref, a);
         return io_result_mk_ok(box(0));
     } else {
         if (lean_to_ref(ref)->m_value != nullptr)
@@ -1002,13 +1352,18 @@ extern "C" LEAN_EXPORT obj_res lean_st_ref_set(b_obj_arg ref, obj_arg a, obj_arg
 
 extern "C" LEAN_EXPORT obj_res lean_st_ref_swap(b_obj_arg ref, obj_arg a, obj_arg) {
     if (ref_maybe_mt(ref)) {
-        /* See io_ref_write */
+        /* See mt_ref_set */
         mark_mt(a);
         atomic<object *> * val_addr = mt_ref_val_addr(ref);
+        object * old_a = val_addr->load();
         while (true) {
-            object * old_a = val_addr->exchange(a);
-            if (old_a != nullptr)
+            if (old_a == nullptr) {
+                mt_ref_wait(ref);
+                old_a = val_addr->load();
+            } else if (val_addr->compare_exchange_weak(old_a, a)) {
+                mt_ref_wait_unannounced(old_a);
                 return io_result_mk_ok(old_a);
+            }
         }
     } else {
         object * old_a = lean_to_ref(ref)->m_value;
@@ -1019,6 +1374,57 @@ extern "C" LEAN_EXPORT obj_res lean_st_ref_swap(b_obj_arg ref, obj_arg a, obj_ar
     }
 }
 
+/* Split the pair `p : β × α` returned by the function of `modifyGetCAS`. */
+static inline void split_pair(obj_arg p, object * & b, object * & a) {
+    b = cnstr_get(p, 0);
+    a = cnstr_get(p, 1);
+    inc(b);
+    inc(a);
+    dec(p);
+}
+
+/*
+  modifyGetCAS {α β : Type} (r : @& Ref σ α) (f : α → β × α) : ST σ β
+
+  Unlike `modifyGet`, the ref is never empty while `f` runs: `f` is applied to a shared copy of the
+  current value, and the result is only stored if the ref still contains that value. Otherwise,
+  `f` is applied again to the new value.
+*/
+extern "C" LEAN_EXPORT obj_res lean_st_ref_modify_get_cas(b_obj_arg ref, obj_arg f, obj_arg) {
+    object * b; object * a;
+    if (!ref_maybe_mt(ref)) {
+        object * val = lean_to_ref(ref)->m_value;
+        lean_assert(val != nullptr);
+        lean_to_ref(ref)->m_value = nullptr;
+        split_pair(apply_1(f, val), b, a);
+        /* `f` may have shared `ref` with other threads. */
+        if (ref_maybe_mt(ref))
+            mt_ref_set(ref, a);
+        else
+            lean_to_ref(ref)->m_value = a;
+        return io_result_mk_ok(b);
+    }
+    while (true) {
+        object * val = mt_ref_get(ref);
+        /* We keep an extra reference to `val` until the compare-and-swap so that it cannot be
+           freed and its address reused by a different value in between. */
+        inc(val);
+        inc(f);
+        split_pair(apply_1(f, val), b, a);
+        mark_mt(a);
+        object * expected = val;
+        if (mt_ref_val_addr(ref)->compare_exchange_strong(expected, a)) {
+            mt_ref_release(val);
+            dec(val);
+            dec(f);
+            return io_result_mk_ok(b);
+        }
+        dec(a);
+        dec(b);
+        dec(val);
+    }
+}
+
 extern "C" LEAN_EXPORT obj_res lean_st_ref_ptr_eq(b_obj_arg ref1, b_obj_arg ref2, obj_arg) {
     // TODO(Leo): ref_maybe_mt
     bool r = lean_to_ref(ref1)->m_value == lean_to_ref(ref2)->m_value;
@@ -1087,11 +1493,339 @@ extern "C" LEAN_EXPORT obj_res lean_io_wait_any(b_obj_arg task_list, obj_arg) {
     return io_result_mk_ok(v);
 }
 
+#ifdef LEAN_IO_REACTOR
+/*
+  The I/O reactor is a single thread waiting with `epoll` for file descriptors to become ready, so that
+  pending asynchronous operations do not occupy a task manager worker each. It is started on first use.
+  Each registration watches its own duplicate of the file descriptor so that several operations can wait
+  on the same file.
+*/
+class io_reactor {
+    struct waiter {
+        int                   m_fd;
+        uint32_t              m_events;
+        std::function<bool()> m_on_ready;
+    };
+    mutex                    m_mutex;
+    int                      m_epoll_fd{-1};
+    int                      m_wake_fd{-1};
+    std::unique_ptr<lthread> m_thread;
+
+    void run() {
+        save_stack_info(false);
+        epoll_event events[64];
+        while (true) {
+            int n = epoll_wait(m_epoll_fd, events, 64, -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                lean_internal_panic("epoll_wait failed");
+            }
+            for (int i = 0; i < n; i++) {
+                waiter * w = static_cast<waiter *>(events[i].data.ptr);
+                if (w == nullptr)
+                    return; // `shutdown`
+                if (w->m_on_ready()) {
+                    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, w->m_fd, nullptr);
+                    close(w->m_fd);
+                    delete w;
+                } else {
+                    epoll_event ev;
+                    ev.events   = w->m_events;
+                    ev.data.ptr = w;
+                    epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, w->m_fd, &ev);
+                }
+            }
+        }
+    }
+
+public:
+    bool watch(int fd, bool write, std::function<bool()> const & on_ready) {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_epoll_fd < 0) {
+            m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (m_epoll_fd < 0)
+                return false;
+            m_wake_fd = eventfd(0, EFD_CLOEXEC);
+            epoll_event ev;
+            ev.events   = EPOLLIN;
+            ev.data.ptr = nullptr;
+            if (m_wake_fd < 0 || epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wake_fd, &ev) != 0)
+                lean_internal_panic("failed to initialize the I/O reactor");
+            m_thread.reset(new lthread([this]() { run(); }));
+        }
+        int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (dup_fd < 0)
+            return false;
+        waiter * w = new waiter{dup_fd, (write ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT, on_ready};
+        epoll_event ev;
+        ev.events   = w->m_events;
+        ev.data.ptr = w;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, dup_fd, &ev) != 0) {
+            // e.g. `EPERM` for regular files, which are always ready
+            close(dup_fd);
+            delete w;
+            return false;
+        }
+        return true;
+    }
+
+    void shutdown() {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_thread) {
+            uint64_t one = 1;
+            lean_always_assert(::write(m_wake_fd, &one, sizeof(one)) == sizeof(one));
+            m_thread->join();
+            m_thread.reset();
+            close(m_wake_fd);
+            close(m_epoll_fd);
+            m_epoll_fd = m_wake_fd = -1;
+        }
+    }
+};
+
+static io_reactor * g_io_reactor = nullptr;
+
+bool io_reactor_watch(int fd, bool write, std::function<bool()> const & on_ready) {
+    return g_io_reactor && has_task_manager() && g_io_reactor->watch(fd, write, on_ready);
+}
+
+void finalize_io_reactor() {
+    if (g_io_reactor)
+        g_io_reactor->shutdown();
+}
+
+/*
+  A file descriptor for performing non-blocking operations on `fd` from the reactor, so that a spurious
+  readiness event (e.g., when another reader consumed the data first) cannot block the reactor thread.
+  We must not set `O_NONBLOCK` on `fd` itself: its open file description is shared with other threads
+  and processes (e.g., an inherited stdin), which would then observe spurious `EAGAIN` errors. Pipes,
+  FIFOs, and terminals are reopened through `/proc/self/fd` to get a new description. For sockets, a
+  duplicate is used with `MSG_DONTWAIT`, which only affects the given call.
+*/
+struct io_nonblocking_fd {
+    int  m_fd{-1};
+    bool m_socket{false};
+
+    static io_nonblocking_fd open_for(int fd, bool write) {
+        io_nonblocking_fd r;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+            return r;
+        if (S_ISSOCK(st.st_mode)) {
+            r.m_fd     = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            r.m_socket = true;
+        } else if (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode)) {
+            char path[64];
+            snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+            r.m_fd = ::open(path, (write ? O_WRONLY : O_RDONLY) | O_NONBLOCK | O_CLOEXEC | O_NOCTTY);
+        }
+        return r;
+    }
+
+    bool is_valid() const { return m_fd >= 0; }
+    void close() { ::close(m_fd); }
+
+    ssize_t read(void * buf, size_t n) const {
+        return m_socket ? ::recv(m_fd, buf, n, MSG_DONTWAIT) : ::read(m_fd, buf, n);
+    }
+
+    ssize_t write(void const * buf, size_t n) const {
+        return m_socket ? ::send(m_fd, buf, n, MSG_DONTWAIT | MSG_NOSIGNAL) : ::write(m_fd, buf, n);
+    }
+};
+
+/* Return the number of bytes buffered by `fp` that can be read without using its file descriptor,
+   or -1 if it cannot be determined. */
+static ssize_t io_buffered_input(FILE * fp) {
+#if defined(__GLIBC__)
+    // glibc-specific `FILE` internals
+    return fp->_IO_read_end - fp->_IO_read_ptr;
+#else
+    (void)fp;
+    return -1;
+#endif
+}
+
+static bool io_is_regular_file(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+#else
+bool io_reactor_watch(int, bool, std::function<bool()> const &) {
+    return false;
+}
+
+void finalize_io_reactor() {}
+#endif
+
+obj_res io_result_to_except(obj_arg r) {
+    bool ok = io_result_is_ok(r);
+    object * v = ok ? io_result_get_value(r) : io_result_get_error(r);
+    inc(v);
+    dec(r);
+    object * e = alloc_cnstr(ok ? 1 : 0, 1, 0);
+    cnstr_set(e, 0, v);
+    return e;
+}
+
+extern "C" obj_res lean_io_promise_new(obj_arg);
+extern "C" obj_res lean_io_promise_resolve(obj_arg value, b_obj_arg promise, obj_arg);
+
+obj_res io_new_promise() {
+    object * r = lean_io_promise_new(io_mk_world());
+    object * p = io_result_get_value(r);
+    inc(p);
+    dec(r);
+    return p;
+}
+
+void io_resolve_promise(obj_arg value, b_obj_arg promise) {
+    dec(lean_io_promise_resolve(value, promise, io_mk_world()));
+}
+
+/* (h : Handle) (nbytes : USize) (_ : Unit) : Except IO.Error ByteArray */
+static obj_res io_handle_read_blocking_fn(obj_arg h, obj_arg nbytes, obj_arg) {
+    object * r = lean_io_prim_handle_read(h, lean_unbox_usize(nbytes), io_mk_world());
+    dec(h);
+    dec(nbytes);
+    return io_result_to_except(r);
+}
+
+/* Handle.readAsync : (@& Handle) → USize → BaseIO (Task (Except IO.Error ByteArray)) */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_read_async(b_obj_arg h, usize nbytes, obj_arg w) {
+#ifdef LEAN_IO_REACTOR
+    if (has_task_manager()) {
+        FILE * fp = io_get_handle(h);
+        ssize_t buffered = io_buffered_input(fp);
+        int fd = fileno(fp);
+        if (buffered > 0 || (buffered == 0 && io_is_regular_file(fd))) {
+            // do not block waiting for more than what is already buffered; regular files are always ready
+            if (buffered > 0 && static_cast<usize>(buffered) < nbytes)
+                nbytes = buffered;
+            return io_result_mk_ok(task_pure(io_result_to_except(lean_io_prim_handle_read(h, nbytes, w))));
+        }
+        io_nonblocking_fd nb_fd = buffered == 0 ? io_nonblocking_fd::open_for(fd, false) : io_nonblocking_fd();
+        if (nb_fd.is_valid()) {
+            object * promise = io_new_promise();
+            inc(promise);
+            mark_mt(h);
+            inc(h);
+            bool ok = io_reactor_watch(nb_fd.m_fd, false, [=]() mutable {
+                object * buf = lean_alloc_sarray(1, 0, nbytes);
+                ssize_t n = nb_fd.read(lean_sarray_cptr(buf), nbytes);
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                    dec(buf);
+                    return false;
+                }
+                object * r;
+                if (n < 0) {
+                    dec(buf);
+                    r = io_result_mk_error(decode_io_error(errno, nullptr));
+                } else {
+                    lean_sarray_set_size(buf, n);
+                    r = io_result_mk_ok(buf);
+                }
+                nb_fd.close();
+                io_resolve_promise(io_result_to_except(r), promise);
+                dec(promise);
+                dec(h);
+                return true;
+            });
+            if (ok)
+                return io_result_mk_ok(promise);
+            nb_fd.close();
+            dec(h);
+            dec(promise);
+            dec(promise);
+        }
+    }
+#endif
+    object * c = alloc_closure(io_handle_read_blocking_fn, 2);
+    inc(h);
+    closure_set(c, 0, h);
+    closure_set(c, 1, lean_box_usize(nbytes));
+    return io_result_mk_ok(task_spawn(c, LEAN_DEDICATED_PRIO));
+}
+
+/* (h : Handle) (buf : ByteArray) (_ : Unit) : Except IO.Error Unit */
+static obj_res io_handle_write_blocking_fn(obj_arg h, obj_arg buf, obj_arg) {
+    object * r = lean_io_prim_handle_write(h, buf, io_mk_world());
+    dec(h);
+    dec(buf);
+    return io_result_to_except(r);
+}
+
+/* Handle.writeAsync : (@& Handle) → (@& ByteArray) → BaseIO (Task (Except IO.Error Unit)) */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_write_async(b_obj_arg h, b_obj_arg buf, obj_arg w) {
+#ifdef LEAN_IO_REACTOR
+    if (has_task_manager()) {
+        FILE * fp = io_get_handle(h);
+        // preserve the order with respect to output buffered by previous writes
+        if (fflush(fp) != 0)
+            return io_result_mk_ok(task_pure(io_result_to_except(io_result_mk_error(decode_io_error(errno, nullptr)))));
+        int fd = fileno(fp);
+        if (io_is_regular_file(fd))
+            return io_result_mk_ok(task_pure(io_result_to_except(lean_io_prim_handle_write(h, buf, w))));
+        io_nonblocking_fd nb_fd = io_nonblocking_fd::open_for(fd, true);
+        if (nb_fd.is_valid()) {
+            object * promise = io_new_promise();
+            inc(promise);
+            mark_mt(h);
+            inc(h);
+            mark_mt(buf);
+            inc(buf);
+            usize pos = 0;
+            bool ok = io_reactor_watch(nb_fd.m_fd, true, [=]() mutable {
+                usize sz = lean_sarray_size(buf);
+                object * r = nullptr;
+                while (pos < sz) {
+                    ssize_t n = nb_fd.write(lean_sarray_cptr(buf) + pos, sz - pos);
+                    if (n < 0) {
+                        if (errno == EAGAIN || errno == EWOULDBLOCK)
+                            return false;
+                        if (errno == EINTR)
+                            continue;
+                        r = io_result_mk_error(decode_io_error(errno, nullptr));
+                        break;
+                    }
+                    pos += n;
+                }
+                if (!r)
+                    r = io_result_mk_ok(box(0));
+                nb_fd.close();
+                io_resolve_promise(io_result_to_except(r), promise);
+                dec(promise);
+                dec(buf);
+                dec(h);
+                return true;
+            });
+            if (ok)
+                return io_result_mk_ok(promise);
+            nb_fd.close();
+            dec(buf);
+            dec(h);
+            dec(promise);
+            dec(promise);
+        }
+    }
+#endif
+    object * c = alloc_closure(io_handle_write_blocking_fn, 2);
+    inc(h);
+    closure_set(c, 0, h);
+    inc(buf);
+    closure_set(c, 1, buf);
+    return io_result_mk_ok(task_spawn(c, LEAN_DEDICATED_PRIO));
+}
+
 extern "C" LEAN_EXPORT obj_res lean_io_exit(uint8_t code, obj_arg /* w */) {
     exit(code);
 }
 
 void initialize_io() {
+    g_mt_ref_slots = new mt_ref_slot[LEAN_NUM_MT_REF_SLOTS];
+#ifdef LEAN_IO_REACTOR
+    g_io_reactor = new io_reactor();
+#endif
     g_io_error_nullptr_read = lean_mk_io_user_error(mk_ascii_string_unchecked("null reference read"));
     mark_persistent(g_io_error_nullptr_read);
     g_io_handle_external_class = lean_register_external_class(io_handle_finalizer, io_handle_foreach);
@@ -1113,5 +1847,10 @@ void initialize_io() {
 }
 
 void finalize_io() {
+#ifdef LEAN_IO_REACTOR
+    finalize_io_reactor();
+    delete g_io_reactor;
+#endif
+    delete[] g_mt_ref_slots;
 }
 }
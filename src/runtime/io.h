@@ -7,6 +7,7 @@ Author: Leonardo de Moura
 #pragma once
 #include <stdio.h>
 #include <string>
+#include <functional>
 #include <lean/lean.h>
 
 namespace lean {
@@ -16,6 +17,14 @@ LEAN_EXPORT lean_obj_res io_result_mk_error(char const * msg);
 LEAN_EXPORT lean_obj_res io_result_mk_error(std::string const & msg);
 inline lean_obj_res decode_io_error(int errnum, b_lean_obj_arg fname) { return lean_decode_io_error(errnum, fname); }
 LEAN_EXPORT lean_obj_res io_wrap_handle(FILE * hfile);
+/* `Except.ok`/`Except.error` of the result of an `IO` action, for the value of an asynchronous operation. */
+lean_obj_res io_result_to_except(lean_obj_arg r);
+lean_obj_res io_new_promise();
+void io_resolve_promise(lean_obj_arg value, b_lean_obj_arg promise);
+/* Call `on_ready` on the I/O reactor thread whenever `fd` is ready for reading (writing) until it returns `true`.
+   Return `false` if `fd` cannot be watched, e.g. on platforms without a reactor or for regular files. */
+bool io_reactor_watch(int fd, bool write, std::function<bool()> const & on_ready);
+void finalize_io_reactor();
 void initialize_io();
 void finalize_io();
 }
@@ -17,6 +17,8 @@ Revision History:
 
 --*/
 #include <stdint.h>
+#include <string.h>
+#include <vector>
 #include "runtime/mpn.h"
 #include "runtime/debug.h"
 #include "runtime/buffer.h"
@@ -86,11 +88,10 @@ void mpn_sub(mpn_digit const * a, size_t const lnga,
     }
 }
 
-void mpn_mul(mpn_digit const * a, size_t const lnga,
-             mpn_digit const * b, size_t const lngb,
-             mpn_digit * c) {
+static void mpn_mul_basecase(mpn_digit const * a, size_t const lnga,
+                             mpn_digit const * b, size_t const lngb,
+                             mpn_digit * c) {
     // Essentially Knuth's Algorithm M.
-    // Perhaps implement a more efficient version, see e.g., Knuth, Section 4.3.3.
     size_t i;
     mpn_digit k;
 
@@ -148,6 +149,124 @@ public:
     }
 };
 
+// Operands with fewer digits than this are multiplied using Algorithm M.
+#define MUL_KARATSUBA_THRESHOLD 32
+// Quotients with fewer digits than this are computed using Algorithm D.
+#define DIV_DC_THRESHOLD 64
+
+/* c[0..lngc) += a[0..lnga) where lnga <= lngc. Return the carry. */
+static mpn_digit add_in_place(mpn_digit * c, size_t const lngc,
+                              mpn_digit const * a, size_t const lnga) {
+    lean_assert(lnga <= lngc);
+    mpn_digit k = 0;
+    size_t j = 0;
+    for (; j < lnga; j++) {
+        mpn_digit r = c[j] + a[j];
+        bool c1 = r < a[j];
+        c[j] = r + k;
+        k = c1 | (c[j] < r);
+    }
+    for (; k != 0 && j < lngc; j++) {
+        c[j]++;
+        k = c[j] == 0;
+    }
+    return k;
+}
+
+/* c[0..lngc) -= a[0..lnga) where lnga <= lngc. Return the borrow. */
+static mpn_digit sub_in_place(mpn_digit * c, size_t const lngc,
+                              mpn_digit const * a, size_t const lnga) {
+    lean_assert(lnga <= lngc);
+    mpn_digit k = 0;
+    size_t j = 0;
+    for (; j < lnga; j++) {
+        mpn_digit r = c[j] - a[j];
+        bool c1 = r > c[j];
+        mpn_digit t = r - k;
+        k = c1 | (t > r);
+        c[j] = t;
+    }
+    for (; k != 0 && j < lngc; j++) {
+        k = c[j] == 0;
+        c[j]--;
+    }
+    return k;
+}
+
+/* c[0..lng) = |a[0..lnga) - b[0..lngb)| where lng = max(lnga, lngb). Return true if a < b. */
+static bool abs_sub(mpn_digit const * a, size_t const lnga,
+                    mpn_digit const * b, size_t const lngb,
+                    mpn_digit * c) {
+    mpn_digit borrow;
+    if (mpn_compare(a, lnga, b, lngb) >= 0) {
+        mpn_sub(a, lnga, b, lngb, c, &borrow);
+        return false;
+    } else {
+        mpn_sub(b, lngb, a, lnga, c, &borrow);
+        return true;
+    }
+}
+
+/*
+  c[0..2n) = a[0..n) * b[0..n) using Karatsuba's method (Knuth, Section 4.3.3).
+  With a = a1*B^l + a0 and b = b1*B^l + b0,
+
+      a*b = a1*b1*B^(2l) + (a0*b0 + a1*b1 - (a0 - a1)*(b0 - b1))*B^l + a0*b0
+*/
+static void mpn_mul_karatsuba(mpn_digit const * a, mpn_digit const * b, size_t const n,
+                              mpn_digit * c) {
+    if (n < MUL_KARATSUBA_THRESHOLD) {
+        mpn_mul_basecase(a, n, b, n, c);
+        return;
+    }
+    size_t l = n / 2;
+    size_t h = n - l;
+    mpn_buffer tmp(6*h + 1);
+    mpn_digit * da  = tmp.data();  // |a0 - a1|, h digits
+    mpn_digit * db  = da + h;      // |b0 - b1|, h digits
+    mpn_digit * p   = db + h;      // |a0 - a1|*|b0 - b1|, 2h digits
+    mpn_digit * mid = p + 2*h;     // middle coefficient, 2h+1 digits
+    bool neg = abs_sub(a, l, a + l, h, da) != abs_sub(b, l, b + l, h, db);
+    mpn_mul_karatsuba(a, b, l, c);
+    mpn_mul_karatsuba(a + l, b + l, h, c + 2*l);
+    mpn_mul_karatsuba(da, db, h, p);
+    for (size_t i = 0; i < 2*h; i++)
+        mid[i] = c[2*l + i];
+    mid[2*h] = 0;
+    add_in_place(mid, 2*h + 1, c, 2*l);
+    if (neg)
+        add_in_place(mid, 2*h + 1, p, 2*h);
+    else
+        sub_in_place(mid, 2*h + 1, p, 2*h);
+    mpn_digit carry = add_in_place(c + l, 2*n - l, mid, 2*h + 1);
+    lean_assert(carry == 0);
+    (void)carry;
+}
+
+void mpn_mul(mpn_digit const * a, size_t const lnga,
+             mpn_digit const * b, size_t const lngb,
+             mpn_digit * c) {
+    if (lnga < lngb) {
+        mpn_mul(b, lngb, a, lnga, c);
+        return;
+    }
+    if (lngb < MUL_KARATSUBA_THRESHOLD) {
+        mpn_mul_basecase(a, lnga, b, lngb, c);
+    } else if (lnga == lngb) {
+        mpn_mul_karatsuba(a, b, lnga, c);
+    } else {
+        // Multiply b by lngb-digit slices of a and accumulate the partial products.
+        mpn_buffer tmp(2*lngb);
+        for (size_t i = 0; i < lnga + lngb; i++)
+            c[i] = 0;
+        for (size_t i = 0; i < lnga; i += lngb) {
+            size_t len = (lnga - i < lngb) ? lnga - i : lngb;
+            mpn_mul(a + i, len, b, lngb, tmp.data());
+            add_in_place(c + i, lnga + lngb - i, tmp.data(), len + lngb);
+        }
+    }
+}
+
 static size_t div_normalize(mpn_digit const * numer, size_t const lnum,
                             mpn_digit const * denom, size_t const lden,
                             mpn_buffer & n_numer,
@@ -265,6 +384,97 @@ static void div_n(mpn_buffer & numer, mpn_buffer const & denom,
     }
 }
 
+/*
+  Basecase of mpn_div_dc: divide a[0..n+m) by the normalized b[0..n) using Algorithm D.
+*/
+static void div_dc_basecase(mpn_digit * a, size_t const n, size_t const m,
+                            mpn_digit const * b, mpn_digit * quot) {
+    mpn_buffer u(n+m+1, 0), v(n, 0), t_ms, t_ab;
+    for (size_t i = 0; i < n+m; i++)
+        u[i] = a[i];
+    for (size_t i = 0; i < n; i++)
+        v[i] = b[i];
+    if (n == 1)
+        div_1(u, v[0], quot);
+    else
+        div_n(u, v, quot, nullptr, t_ms, t_ab);
+    for (size_t i = 0; i < n; i++)
+        a[i] = u[i];
+    for (size_t i = n; i < n+m; i++)
+        a[i] = 0;
+}
+
+/*
+  x[0..lngx) -= t[0..lngt), adding b[0..n) to x and decrementing q[0..lngq)
+  until the difference is nonnegative.
+*/
+static void div_dc_sub(mpn_digit * x, size_t const lngx,
+                       mpn_digit const * t, size_t const lngt,
+                       mpn_digit const * b, size_t const n,
+                       mpn_digit * q, size_t const lngq) {
+    static const mpn_digit one = 1;
+    while (mpn_compare(x, lngx, t, lngt) < 0) {
+        sub_in_place(q, lngq, &one, 1);
+        add_in_place(x, lngx, b, n);
+    }
+    sub_in_place(x, lngx, t, lngt);
+}
+
+/*
+  Divide a[0..n+m) by the normalized b[0..n) where m <= n, using the recursive division of
+  Burnikel and Ziegler (see Brent and Zimmermann, Modern Computer Arithmetic, Algorithm 1.8).
+  The m+1 quotient digits are stored in quot, the remainder is stored in a[0..n)
+  and a[n..n+m) is cleared.
+*/
+static void mpn_div_dc(mpn_digit * a, size_t const n, size_t const m,
+                       mpn_digit const * b, mpn_digit * quot) {
+    lean_assert(m <= n);
+    if (m < DIV_DC_THRESHOLD) {
+        div_dc_basecase(a, n, m, b, quot);
+        return;
+    }
+    // b = b1*B^k + b0
+    size_t k = m / 2;
+    mpn_digit const * b0 = b;
+    mpn_digit const * b1 = b + k;
+    mpn_buffer t(m+1, 0), q0(k+1, 0);
+    // q1 = (a div B^(2k)) div b1, stored in quot[k..m]
+    mpn_div_dc(a + 2*k, n - k, m - k, b1, quot + k);
+    // a = a - q1*b0*B^k, the remainder is now in a[k..n+k)
+    mpn_mul(quot + k, m - k + 1, b0, k, t.data());
+    div_dc_sub(a + k, n + 1, t.data(), m + 1, b, n, quot + k, m - k + 1);
+    // q0 = (a div B^k) div b1
+    mpn_div_dc(a + k, n - k, k, b1, q0.data());
+    // a = a - q0*b0, the remainder is now in a[0..n)
+    mpn_mul(q0.data(), k + 1, b0, k, t.data());
+    div_dc_sub(a, n + 1, t.data(), 2*k + 1, b, n, q0.data(), k + 1);
+    for (size_t i = 0; i < k; i++)
+        quot[i] = 0;
+    add_in_place(quot, m + 1, q0.data(), k + 1);
+}
+
+static void div_dc(mpn_buffer & numer, mpn_buffer const & denom,
+                   mpn_digit * quot) {
+    // Divide numer by the normalized denom in blocks of at most n quotient digits.
+    size_t n = denom.size();
+    size_t m = numer.size() - n;
+    mpn_buffer q(m+1, 0), t(n+1, 0);
+    size_t s = m % n;
+    if (s == 0) s = n;
+    size_t j = m - s;
+    mpn_div_dc(&numer[j], n, s, denom.data(), &q[j]);
+    while (j > 0) {
+        j -= n;
+        mpn_div_dc(&numer[j], n, n, denom.data(), t.data());
+        lean_assert(t[n] == 0);
+        for (size_t i = 0; i < n; i++)
+            q[j+i] = t[i];
+    }
+    lean_assert(q[m] == 0);
+    for (size_t i = 0; i < m; i++)
+        quot[i] = q[i];
+}
+
 void mpn_div(mpn_digit const * numer, size_t const lnum,
              mpn_digit const * denom, size_t const lden,
              mpn_digit * quot,
@@ -300,6 +510,8 @@ void mpn_div(mpn_digit const * numer, size_t const lnum,
         size_t d = div_normalize(numer, lnum, denom, lden, u, v);
         if (lden == 1)
             div_1(u, v[0], quot);
+        else if (lden >= DIV_DC_THRESHOLD && lnum - lden >= DIV_DC_THRESHOLD)
+            div_dc(u, v, quot);
         else
             div_n(u, v, quot, rem, t_ms, t_ab);
         div_unnormalize(u, v, d, rem);
@@ -318,6 +530,76 @@ void mpn_div(mpn_digit const * numer, size_t const lnum,
 #endif
 }
 
+// Numbers with fewer digits than this are converted from and to decimal one digit at a time.
+#define DEC_DC_THRESHOLD 32
+// Largest power of ten that fits in a digit.
+#define DEC_DIGIT_BASE 1000000000u
+#define DEC_DIGIT_LEN 9
+
+/* Powers 10^(9*2^i) used for divide-and-conquer radix conversion. */
+class dec_powers {
+    std::vector<mpn_buffer> m_pows;
+public:
+    dec_powers() {
+        m_pows.reserve(64);
+        m_pows.push_back(mpn_buffer(1, DEC_DIGIT_BASE));
+    }
+    /* Return 10^(9*2^i). */
+    mpn_buffer const & operator[](size_t i) {
+        while (m_pows.size() <= i) {
+            mpn_buffer const & p = m_pows.back();
+            mpn_buffer sq(2*p.size(), 0);
+            mpn_mul(p.data(), p.size(), p.data(), p.size(), sq.data());
+            while (sq.back() == 0)
+                sq.pop_back();
+            m_pows.push_back(sq);
+        }
+        return m_pows[i];
+    }
+};
+
+/* Write the decimal digits of a[0..lng) to out[0..width), padded with leading zeros. */
+static void to_dec(mpn_digit const * a, size_t lng, char * out, size_t width, dec_powers & pows) {
+    while (lng > 1 && a[lng-1] == 0)
+        lng--;
+    if (lng < DEC_DC_THRESHOLD) {
+        mpn_buffer t(lng, 0);
+        for (size_t i = 0; i < lng; i++)
+            t[i] = a[i];
+        size_t j = width;
+        while (lng > 0) {
+            // t, r = t div 10^9, t mod 10^9
+            mpn_double_digit r = 0;
+            for (size_t i = lng; i-- > 0;) {
+                mpn_double_digit u = (r << DIGIT_BITS) | t[i];
+                t[i] = static_cast<mpn_digit>(u / DEC_DIGIT_BASE);
+                r = u % DEC_DIGIT_BASE;
+            }
+            while (lng > 0 && t[lng-1] == 0)
+                lng--;
+            for (unsigned k = 0; k < DEC_DIGIT_LEN && j > 0 && (lng > 0 || r != 0); k++) {
+                out[--j] = '0' + static_cast<char>(r % 10);
+                r /= 10;
+            }
+            lean_assert(r == 0);
+        }
+        while (j > 0)
+            out[--j] = '0';
+        return;
+    }
+    // a = q * 10^w + r where 10^w has about half the digits of a
+    size_t i = 0;
+    while (2*pows[i+1].size() - 1 <= lng)
+        i++;
+    mpn_buffer const & p = pows[i];
+    size_t w = static_cast<size_t>(DEC_DIGIT_LEN) << i;
+    lean_assert(w < width);
+    mpn_buffer q(lng - p.size() + 1, 0), r(p.size(), 0);
+    mpn_div(a, lng, p.data(), p.size(), q.data(), r.data());
+    to_dec(q.data(), q.size(), out, width - w, pows);
+    to_dec(r.data(), r.size(), out + width - w, w, pows);
+}
+
 char * mpn_to_string(mpn_digit const * a, size_t const lng, char * buf, size_t const lbuf) {
     lean_assert(buf && lbuf > 0);
 
@@ -329,28 +611,76 @@ char * mpn_to_string(mpn_digit const * a, size_t const lng, char * buf, size_t c
 #endif
     }
     else {
-        mpn_buffer temp(lng, 0), t_numer(lng+1, 0), t_denom(1, 0);
-        for (unsigned i = 0; i < lng; i++)
-            temp[i] = a[i];
-
+        // A digit has at most 10 decimal digits.
+        size_t width = 10*lng;
+        lean_assert(width < lbuf);
+        dec_powers pows;
+        to_dec(a, lng, buf, width, pows);
         size_t j = 0;
-        mpn_digit rem;
-        mpn_digit ten = 10;
-        while (!temp.empty() && (temp.size() > 1 || temp[0] != 0)) {
-            size_t d = div_normalize(&temp[0], temp.size(), &ten, 1, t_numer, t_denom);
-            div_1(t_numer, t_denom[0], &temp[0]);
-            div_unnormalize(t_numer, t_denom, d, &rem);
-            buf[j++] = '0' + rem;
-            while (!temp.empty() && temp.back() == 0)
-                temp.pop_back();
-        }
-        buf[j] = 0;
-
-        j--;
-        size_t mid = (j/2) + ((j % 2) ? 1 : 0);
-        for (size_t i = 0; i < mid; i++)
-            std::swap(buf[i], buf[j-i]);
+        while (j + 1 < width && buf[j] == '0')
+            j++;
+        memmove(buf, buf + j, width - j);
+        buf[width - j] = 0;
     }
     return buf;
 }
+
+/* Store the number denoted by the decimal digits str[0..len) in c[0..lngc). */
+static void from_dec(char const * str, size_t len, mpn_digit * c, size_t lngc, dec_powers & pows) {
+    for (size_t i = 0; i < lngc; i++)
+        c[i] = 0;
+    if (len <= DEC_DIGIT_LEN * DEC_DC_THRESHOLD) {
+        size_t lng = 0;
+        size_t k = len % DEC_DIGIT_LEN;
+        if (k == 0) k = DEC_DIGIT_LEN;
+        while (len > 0) {
+            mpn_digit m = 1, v = 0;
+            for (size_t j = 0; j < k; j++) {
+                m *= 10;
+                v  = 10*v + static_cast<mpn_digit>(str[j] - '0');
+            }
+            // c = c * 10^k + v
+            mpn_double_digit t = v;
+            for (size_t i = 0; i < lng; i++) {
+                t += static_cast<mpn_double_digit>(c[i]) * m;
+                c[i] = static_cast<mpn_digit>(t);
+                t >>= DIGIT_BITS;
+            }
+            if (t != 0) {
+                lean_assert(lng < lngc);
+                c[lng++] = static_cast<mpn_digit>(t);
+            }
+            str += k;
+            len -= k;
+            k    = DEC_DIGIT_LEN;
+        }
+        return;
+    }
+    // str = hi lo where lo has w digits, c = hi * 10^w + lo
+    size_t i = 0;
+    while ((static_cast<size_t>(DEC_DIGIT_LEN) << (i+1)) < len)
+        i++;
+    size_t w = static_cast<size_t>(DEC_DIGIT_LEN) << i;
+    mpn_buffer const & p = pows[i];
+    size_t lhi = (len - w) / DEC_DIGIT_LEN + 1;
+    size_t llo = w / DEC_DIGIT_LEN + 1;
+    mpn_buffer hi(lhi, 0), lo(llo, 0), t(lhi + p.size(), 0);
+    from_dec(str, len - w, hi.data(), lhi, pows);
+    from_dec(str + len - w, w, lo.data(), llo, pows);
+    mpn_mul(hi.data(), lhi, p.data(), p.size(), t.data());
+    while (llo > 1 && lo[llo-1] == 0)
+        llo--;
+    add_in_place(t.data(), t.size(), lo.data(), llo);
+    for (size_t j = 0; j < t.size(); j++) {
+        lean_assert(j < lngc || t[j] == 0);
+        if (j < lngc)
+            c[j] = t[j];
+    }
+}
+
+void mpn_from_string(char const * str, size_t const len, mpn_digit * c, size_t const lngc) {
+    lean_assert(lngc >= len / DEC_DIGIT_LEN + 1);
+    dec_powers pows;
+    from_dec(str, len, c, lngc, pows);
+}
 }
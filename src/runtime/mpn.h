@@ -45,4 +45,8 @@ void mpn_div(mpn_digit const * numer, size_t lnum,
 
 char * mpn_to_string(mpn_digit const * a, size_t lng,
                      char * buf, size_t lbuf);
+
+/* Store the number denoted by the decimal digits str[0..len) in c[0..lngc), lngc >= len/9 + 1. */
+void mpn_from_string(char const * str, size_t len,
+                     mpn_digit * c, size_t lngc);
 }
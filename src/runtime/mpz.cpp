@@ -330,12 +330,17 @@ void mpz::init_str(char const * v) {
     while (str[0] == ' ') ++str;
     if (str[0] == '-')
         sign = true;
-    while (str[0]) {
-        if ('0' <= str[0] && str[0] <= '9') {
-            operator*=(10);
-            operator+=(static_cast<unsigned>(str[0] - '0'));
-        }
-        ++str;
+    buffer<char, 1024> dec;
+    for (; str[0]; ++str) {
+        if ('0' <= str[0] && str[0] <= '9')
+            dec.push_back(str[0]);
+    }
+    if (!dec.empty()) {
+        buffer<mpn_digit, 256> tmp;
+        size_t sz = dec.size() / 9 + 1;
+        tmp.resize(sz, 0);
+        mpn_from_string(dec.data(), dec.size(), tmp.data(), sz);
+        set(sz, tmp.data());
     }
     if (sign)
         neg();
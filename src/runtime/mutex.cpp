@@ -27,7 +27,12 @@ extern "C" LEAN_EXPORT obj_res lean_io_basemutex_new(obj_arg) {
 }
 
 extern "C" LEAN_EXPORT obj_res lean_io_basemutex_lock(b_obj_arg mtx, obj_arg) {
-    basemutex_get(mtx)->lock();
+    mutex * m = basemutex_get(mtx);
+    if (!m->try_lock()) {
+        // the holder may be waiting for objects we have not released yet
+        flush_deferred_dec();
+        m->lock();
+    }
     return io_result_mk_ok(box(0));
 }
 
@@ -51,6 +56,7 @@ extern "C" LEAN_EXPORT obj_res lean_io_condvar_new(obj_arg) {
 }
 
 extern "C" LEAN_EXPORT obj_res lean_io_condvar_wait(b_obj_arg condvar, b_obj_arg mtx, obj_arg) {
+    flush_deferred_dec();
     unique_lock<mutex> lock(*basemutex_get(mtx), std::adopt_lock_t());
     condvar_get(condvar)->wait(lock);
     lock.release();
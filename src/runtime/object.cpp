@@ -8,6 +8,7 @@ Author: Leonardo de Moura
 #include <algorithm>
 #include <vector>
 #include <deque>
+#include <unordered_map>
 #include <cmath>
 #include <lean/lean.h>
 #include "runtime/object.h"
@@ -20,7 +21,9 @@ Author: Leonardo de Moura
 #include "runtime/interrupt.h"
 #include "runtime/buffer.h"
 #include "runtime/io.h"
+#include "runtime/stack_overflow.h"
 #include "runtime/hash.h"
+#include "runtime/task_trace.h"
 
 #ifdef __GLIBC__
 #include <execinfo.h>
@@ -43,6 +46,15 @@ Author: Leonardo de Moura
 
 // see `Task.Priority.max`
 #define LEAN_MAX_PRIO 8
+/* Maximal number of standard workers spawned beyond the configured parallelism to compensate for workers
+   blocked waiting for tasks (see `task_manager::begin_blocking_wait`). */
+#define LEAN_MAX_COMPENSATING_WORKERS 128
+
+#ifdef LEAN_RUNTIME_STATS
+#define LEAN_RUNTIME_STAT_CODE(c) c
+#else
+#define LEAN_RUNTIME_STAT_CODE(c)
+#endif
 
 namespace lean {
 
@@ -160,10 +172,52 @@ static inline void lean_dealloc(lean_object * o, size_t sz) {
 #endif
 }
 
+/* Scalar arrays whose memory was not allocated by the runtime, see `register_foreign_sarray`. */
+struct foreign_sarray {
+    foreign_sarray_finalizer m_finalize;
+    void *                   m_data;
+    size_t                   m_size;
+};
+
+static std::unordered_map<lean_object *, foreign_sarray> * g_foreign_sarrays = nullptr;
+static mutex *                                             g_foreign_sarrays_mutex = nullptr;
+static std::atomic<size_t>                                 g_num_foreign_sarrays(0);
+
+void register_foreign_sarray(lean_object * o, foreign_sarray_finalizer fn, void * data, size_t size) {
+    lean_assert(lean_sarray_byte_size(o) > LEAN_MAX_SMALL_OBJECT_SIZE);
+    lock_guard<mutex> lock(*g_foreign_sarrays_mutex);
+    g_foreign_sarrays->insert({o, foreign_sarray{fn, data, size}});
+    g_num_foreign_sarrays++;
+}
+
+/* If `o` is a foreign scalar array, finalize it and return true. */
+static bool free_foreign_sarray(lean_object * o) {
+    foreign_sarray a;
+    {
+        lock_guard<mutex> lock(*g_foreign_sarrays_mutex);
+        auto it = g_foreign_sarrays->find(o);
+        if (it == g_foreign_sarrays->end())
+            return false;
+        a = it->second;
+        g_foreign_sarrays->erase(it);
+        g_num_foreign_sarrays--;
+    }
+    a.m_finalize(a.m_data, a.m_size);
+    return true;
+}
+
+static inline void lean_dealloc_sarray(lean_object * o) {
+    size_t sz = lean_sarray_byte_size(o);
+    if (LEAN_UNLIKELY(sz > LEAN_MAX_SMALL_OBJECT_SIZE) && g_num_foreign_sarrays.load(std::memory_order_relaxed) > 0 &&
+        free_foreign_sarray(o))
+        return;
+    lean_dealloc(o, sz);
+}
+
 extern "C" LEAN_EXPORT void lean_free_object(lean_object * o) {
     switch (lean_ptr_tag(o)) {
     case LeanArray:       return lean_dealloc(o, lean_array_byte_size(o));
-    case LeanScalarArray: return lean_dealloc(o, lean_sarray_byte_size(o));
+    case LeanScalarArray: return lean_dealloc_sarray(o);
     case LeanString:      return lean_dealloc(o, lean_string_byte_size(o));
     case LeanMPZ:         to_mpz(o)->m_value.~mpz(); return lean_free_small_object(o);
     default:              return lean_free_small_object(o);
@@ -268,7 +322,7 @@ static void lean_del_core(object * o, object * & todo) {
             break;
         }
         case LeanScalarArray:
-            lean_dealloc(o, lean_sarray_byte_size(o));
+            lean_dealloc_sarray(o);
             break;
         case LeanString:
             lean_dealloc(o, lean_string_byte_size(o));
@@ -299,20 +353,185 @@ static void lean_del_core(object * o, object * & todo) {
     }
 }
 
-extern "C" LEAN_EXPORT void lean_dec_ref_cold(lean_object * o) {
-    if (o->m_rc == 1 || std::atomic_fetch_add_explicit(lean_get_rc_mt_addr(o), 1, std::memory_order_acq_rel) == -1) {
+#ifdef LEAN_INCREMENTAL_DEL
+/*
+  Unreachable graphs are freed in bounded slices instead of all at once. Objects whose release
+  has been postponed are kept in a per-thread list, and each `lean_del` visits at most
+  `LEAN_DEL_SLICE_SIZE` children of pending objects. Large arrays are released a slice of
+  elements at a time. Thus, dropping the last reference to a huge graph (e.g., an old
+  environment) does not stall the current thread, and the remaining work is spread over
+  subsequent deallocations. The pending objects are always released by the thread that dropped
+  them: their children may be single-threaded objects that are still shared with this thread,
+  so we cannot hand them to another thread. Cross-heap deallocations go through the usual export
+  lists of the small object allocator.
+  Remark: until a pending object is released, its children keep the reference it owns. So a
+  live object that is also reachable from a pending graph is shared, and updating it copies it
+  instead of updating it in place.
+*/
+#define LEAN_DEL_SLICE_SIZE 4096
+
+LEAN_THREAD_PTR(object, g_pending_del);
+LEAN_THREAD_VALUE(bool, g_pending_del_finalizer, false);
+
+static inline size_t num_children(object * o) {
+    uint8 tag = lean_ptr_tag(o);
+    if (tag <= LeanMaxCtorTag)
+        return lean_ctor_num_objs(o);
+    switch (tag) {
+    case LeanClosure: return lean_closure_num_fixed(o);
+    case LeanArray:   return lean_array_size(o);
+    case LeanThunk:   return 2;
+    case LeanRef:     return 1;
+    default:          return 0;
+    }
+}
+
+/* Release pending objects, visiting at most `budget` of their children. */
+static void del_pending(size_t budget) {
+    while (g_pending_del != nullptr && budget > 0) {
+        object * o = g_pending_del;
+        size_t n = num_children(o);
+        if (n > budget && lean_ptr_tag(o) == LeanArray) {
+            /* Release the last `budget` elements, and keep the rest of the array pending. Children
+               are pushed on top of the array, and the array stays valid since it is unreachable. */
+            lean_to_array(o)->m_size = n - budget;
+            object ** it  = lean_array_cptr(o) + n - budget;
+            object ** end = lean_array_cptr(o) + n;
+            for (; it != end; ++it) dec(*it, g_pending_del);
+            return;
+        }
+        pop_back(g_pending_del);
+        lean_del_core(o, g_pending_del);
+        budget -= std::min(budget, n + 1);
+    }
+}
+
+static void finalize_pending_del(void *) {
+    while (g_pending_del != nullptr)
+        del_pending(LEAN_DEL_SLICE_SIZE);
+    g_pending_del_finalizer = false;
+}
+
+static bool has_pending_del() {
+    return g_pending_del != nullptr;
+}
+#endif
+
+static void lean_del(lean_object * o) {
 #ifdef LEAN_LAZY_RC
-        push_back(g_to_free, o);
+    push_back(g_to_free, o);
+#elif defined(LEAN_INCREMENTAL_DEL)
+    push_back(g_pending_del, o);
+    del_pending(LEAN_DEL_SLICE_SIZE);
+    if (g_pending_del != nullptr && !g_pending_del_finalizer) {
+        g_pending_del_finalizer = true;
+        register_thread_finalizer(finalize_pending_del, nullptr);
+    }
 #else
-        object * todo = nullptr;
-        while (true) {
-            lean_del_core(o, todo);
-            if (todo == nullptr)
-                return;
-            o = pop_back(todo);
-        }
+    object * todo = nullptr;
+    while (true) {
+        lean_del_core(o, todo);
+        if (todo == nullptr)
+            return;
+        o = pop_back(todo);
+    }
+#endif
+}
+
+#ifdef LEAN_MT_DEFERRED_DEC
+/*
+  Decrements of multi-threaded objects are buffered per thread and applied in batches, where
+  repeated decrements of the same object are combined into a single atomic operation.
+  Deferring a decrement only extends the lifetime of an object, and multi-threaded objects are
+  never considered exclusive (see `lean_is_exclusive`), so destructive updates are not affected.
+  We do not defer tasks and external objects since releasing them has observable effects
+  (cancellation, finalizers). They may still be reachable from deferred objects, so a thread
+  applies its deferred decrements (`flush_deferred_dec`) when it finishes a task, when it goes
+  idle, and before blocking on tasks, processes, file locks, reads, sleeps, mutexes, condition
+  variables, or empty refs, where another thread or process may be waiting for them to be released.
+*/
+#define LEAN_MT_DEC_BUFFER_CAPACITY 1024
+
+struct mt_dec_buffer {
+    object * m_objs[LEAN_MT_DEC_BUFFER_CAPACITY];
+    unsigned m_size{0};
+    /* Set while applying the buffered decrements. Decrements performed by finalizers
+       during that time are not deferred. */
+    bool     m_flushing{false};
+};
+
+LEAN_THREAD_PTR(mt_dec_buffer, g_mt_dec_buffer);
+
+static void flush_mt_dec_buffer(mt_dec_buffer & b) {
+    b.m_flushing = true;
+    std::sort(b.m_objs, b.m_objs + b.m_size);
+    unsigned i = 0;
+    while (i < b.m_size) {
+        object * o = b.m_objs[i];
+        unsigned j = i + 1;
+        while (j < b.m_size && b.m_objs[j] == o) j++;
+        int n = j - i;
+        if (std::atomic_fetch_add_explicit(lean_get_rc_mt_addr(o), n, std::memory_order_acq_rel) == -n)
+            lean_del(o);
+        i = j;
+    }
+    b.m_size     = 0;
+    b.m_flushing = false;
+}
+
+static void finalize_mt_dec_buffer(void * p) {
+    mt_dec_buffer * b = static_cast<mt_dec_buffer *>(p);
+    flush_mt_dec_buffer(*b);
+    delete b;
+    g_mt_dec_buffer = nullptr;
+}
+
+static bool has_deferred_mt_dec() {
+    return g_mt_dec_buffer && g_mt_dec_buffer->m_size > 0;
+}
+
+static void flush_deferred_mt_dec() {
+    if (g_mt_dec_buffer)
+        flush_mt_dec_buffer(*g_mt_dec_buffer);
+}
+
+/* Return true if the decrement of the multi-threaded object `o` has been deferred. */
+static inline bool defer_mt_dec(object * o) {
+    uint8 tag = lean_ptr_tag(o);
+    if (tag == LeanTask || tag == LeanExternal)
+        return false;
+    if (!g_mt_dec_buffer) {
+        g_mt_dec_buffer = new mt_dec_buffer();
+        register_thread_finalizer(finalize_mt_dec_buffer, g_mt_dec_buffer);
+    }
+    mt_dec_buffer & b = *g_mt_dec_buffer;
+    if (b.m_flushing)
+        return false;
+    if (b.m_size == LEAN_MT_DEC_BUFFER_CAPACITY)
+        flush_mt_dec_buffer(b);
+    b.m_objs[b.m_size++] = o;
+    return true;
+}
 #endif
+
+void flush_deferred_dec() {
+#ifdef LEAN_MT_DEFERRED_DEC
+    if (has_deferred_mt_dec())
+        flush_deferred_mt_dec();
+#endif
+}
+
+extern "C" LEAN_EXPORT void lean_dec_ref_cold(lean_object * o) {
+    if (o->m_rc == 1) {
+        lean_del(o);
+        return;
     }
+#ifdef LEAN_MT_DEFERRED_DEC
+    if (defer_mt_dec(o))
+        return;
+#endif
+    if (std::atomic_fetch_add_explicit(lean_get_rc_mt_addr(o), 1, std::memory_order_acq_rel) == -1)
+        lean_del(o);
 }
 
 
@@ -366,6 +585,22 @@ extern "C" LEAN_EXPORT lean_obj_res lean_array_set_panic(lean_obj_arg a, lean_ob
 // =======================================
 // Thunks
 
+/* Threads that lose the race for evaluating a thunk block on a "parking slot" selected by the thunk address.
+   The thread evaluating the thunk only takes the slot lock if `m_num_waiters` is not zero,
+   so uncontended forcing does not pay for the notification. */
+struct thunk_parking_slot {
+    mutex              m_mutex;
+    condition_variable m_cv;
+    atomic<unsigned>   m_num_waiters{0};
+};
+
+#define LEAN_NUM_THUNK_PARKING_SLOTS 64
+static thunk_parking_slot * g_thunk_parking_slots = nullptr;
+
+static thunk_parking_slot & get_thunk_parking_slot(b_obj_arg t) {
+    return g_thunk_parking_slots[(reinterpret_cast<size_t>(t) / sizeof(lean_thunk_object)) % LEAN_NUM_THUNK_PARKING_SLOTS];
+}
+
 extern "C" LEAN_EXPORT b_obj_res lean_thunk_get_core(b_obj_arg t) {
     object * c = lean_to_thunk(t)->m_closure.exchange(nullptr);
     if (c != nullptr) {
@@ -381,14 +616,24 @@ extern "C" LEAN_EXPORT b_obj_res lean_thunk_get_core(b_obj_arg t) {
         lean_assert(lean_to_thunk(t)->m_value == nullptr);
         mark_mt(r);
         lean_to_thunk(t)->m_value = r;
+        /* Both the store above and the load below are sequentially consistent. Thus, either we see
+           the waiter registered by another thread, or that thread sees `m_value` before blocking. */
+        thunk_parking_slot & slot = get_thunk_parking_slot(t);
+        if (slot.m_num_waiters.load() > 0) {
+            lock_guard<mutex> lock(slot.m_mutex);
+            slot.m_cv.notify_all();
+        }
         return r;
     } else {
         lean_assert(c == nullptr);
-        /* There is another thread executing the closure. We keep waiting for the m_value to be
-           set by another thread. */
-        while (!lean_to_thunk(t)->m_value) {
-            this_thread::yield();
+        /* There is another thread executing the closure. We block until `m_value` is set by that thread. */
+        thunk_parking_slot & slot = get_thunk_parking_slot(t);
+        slot.m_num_waiters++;
+        {
+            unique_lock<mutex> lock(slot.m_mutex);
+            slot.m_cv.wait(lock, [&]() { return lean_to_thunk(t)->m_value != nullptr; });
         }
+        slot.m_num_waiters--;
         return lean_to_thunk(t)->m_value;
     }
 }
@@ -475,6 +720,27 @@ extern "C" LEAN_EXPORT void lean_mark_persistent(object * o) {
     }
 }
 
+extern "C" LEAN_EXPORT object * lean_closed_term_init(object ** p, object * (*init)(void)) {
+    std::atomic<object *> * slot = reinterpret_cast<std::atomic<object *> *>(p);
+    object * r = nullptr;
+    if (slot->load(std::memory_order_acquire) == nullptr) {
+        r = init();
+        object * expected = nullptr;
+        if (slot->compare_exchange_strong(expected, LEAN_CLOSED_TERM_BUSY, std::memory_order_acq_rel)) {
+            /* Mark `r` as persistent before publishing it: readers do not increment the RC of closed terms. */
+            lean_mark_persistent(r);
+            slot->store(r, std::memory_order_release);
+            return r;
+        }
+    }
+    /* Another thread was faster. `r` is still single-threaded and only referenced by us. */
+    if (r != nullptr)
+        lean_dec(r);
+    while ((r = slot->load(std::memory_order_acquire)) == LEAN_CLOSED_TERM_BUSY)
+        this_thread::yield();
+    return r;
+}
+
 // =======================================
 // Mark MT
 
@@ -486,24 +752,56 @@ static obj_res mark_mt_fn(obj_arg o) {
     return lean_box(0);
 }
 
+#ifdef LEAN_RUNTIME_STATS
+static atomic<uint64> g_num_mark_mt(0);
+static atomic<uint64> g_num_mark_mt_objs(0);
+static atomic<uint64> g_max_mark_mt_objs(0);
+struct mark_mt_stats {
+    ~mark_mt_stats() {
+        std::cerr << "num. mark mt:        " << g_num_mark_mt << "\n";
+        std::cerr << "num. mark mt objs:   " << g_num_mark_mt_objs << "\n";
+        std::cerr << "max. mark mt objs:   " << g_max_mark_mt_objs << "\n";
+    }
+};
+static mark_mt_stats g_mark_mt_stats;
+
+static void update_mark_mt_stats(uint64 num_objs) {
+    g_num_mark_mt++;
+    g_num_mark_mt_objs += num_objs;
+    uint64 max = g_max_mark_mt_objs;
+    while (num_objs > max && !g_max_mark_mt_objs.compare_exchange_weak(max, num_objs)) {}
+}
+#endif
+
+/* Only objects that are still single-threaded are visited. Multi-threaded and persistent objects
+   are not traversed since all objects reachable from them have already been marked. So, marking
+   an object that is handed to several tasks costs a full traversal only the first time. */
+static inline void push_st(buffer<object*> & todo, object * o) {
+    if (!lean_is_scalar(o) && lean_is_st(o))
+        todo.push_back(o);
+}
+
 extern "C" LEAN_EXPORT void lean_mark_mt(object * o) {
 #ifndef LEAN_MULTI_THREAD
     return;
 #endif
     if (lean_is_scalar(o) || !lean_is_st(o)) return;
 
+    LEAN_RUNTIME_STAT_CODE(uint64 num_objs = 0);
     buffer<object*> todo;
     todo.push_back(o);
     while (!todo.empty()) {
         object * o = todo.back();
         todo.pop_back();
-        if (!lean_is_scalar(o) && lean_is_st(o)) {
+        /* `o` may have been pushed more than once if it is shared. */
+        if (lean_is_st(o)) {
+            LEAN_RUNTIME_STAT_CODE(num_objs++);
             o->m_rc = -o->m_rc;
             uint8_t tag = lean_ptr_tag(o);
             if (tag <= LeanMaxCtorTag) {
                 object ** it  = lean_ctor_obj_cptr(o);
                 object ** end = it + lean_ctor_num_objs(o);
-                for (; it != end; ++it) todo.push_back(*it);
+                for (; it != end; ++it) push_st(todo, *it);
             } else {
                 switch (tag) {
                 case LeanScalarArray:
@@ -517,26 +815,26 @@ extern "C" LEAN_EXPORT void lean_mark_mt(object * o) {
                     break;
                 }
                 case LeanTask:
-                    todo.push_back(lean_task_get(o));
+                    push_st(todo, lean_task_get(o));
                     break;
                 case LeanClosure: {
                     object ** it  = lean_closure_arg_cptr(o);
                     object ** end = it + lean_closure_num_fixed(o);
-                    for (; it != end; ++it) todo.push_back(*it);
+                    for (; it != end; ++it) push_st(todo, *it);
                     break;
                 }
                 case LeanArray: {
                     object ** it  = lean_array_cptr(o);
                     object ** end = it + lean_array_size(o);
-                    for (; it != end; ++it) todo.push_back(*it);
+                    for (; it != end; ++it) push_st(todo, *it);
                     break;
                 }
                 case LeanThunk:
-                    if (object * c = lean_to_thunk(o)->m_closure) todo.push_back(c);
-                    if (object * v = lean_to_thunk(o)->m_value) todo.push_back(v);
+                    if (object * c = lean_to_thunk(o)->m_closure) push_st(todo, c);
+                    if (object * v = lean_to_thunk(o)->m_value) push_st(todo, v);
                     break;
                 case LeanRef:
-                    if (object * v = lean_to_ref(o)->m_value) todo.push_back(v);
+                    if (object * v = lean_to_ref(o)->m_value) push_st(todo, v);
                     break;
                 default:
                     lean_unreachable();
@@ -545,12 +843,15 @@ extern "C" LEAN_EXPORT void lean_mark_mt(object * o) {
             }
         }
     }
+    LEAN_RUNTIME_STAT_CODE(update_mark_mt_stats(num_objs));
 }
 
 // =======================================
 // Tasks
 
 LEAN_THREAD_PTR(lean_task_object, g_current_task_object);
+/* `true` in threads of the standard worker pool */
+LEAN_THREAD_VALUE(bool, g_is_std_worker, false);
 
 static lean_task_imp * alloc_task_imp(obj_arg c, unsigned prio, bool keep_alive) {
     lean_task_imp * imp = (lean_task_imp*)lean_alloc_small_object(sizeof(lean_task_imp));
@@ -573,6 +874,9 @@ static void free_task(lean_task_object * t) {
     lean_free_small_object((lean_object*)t);
 }
 
+/* Function of the closure `c` of a task for tracing, looking through the wrappers of `Task.map` and `Task.bind`. */
+static void * task_closure_fn(object * c);
+
 struct scoped_current_task_object : flet<lean_task_object *> {
     scoped_current_task_object(lean_task_object * t):flet(g_current_task_object, t) {}
 };
@@ -581,6 +885,8 @@ class task_manager {
     mutex                                         m_mutex;
     std::vector<std::unique_ptr<lthread>>         m_std_workers;
     unsigned                                      m_idle_std_workers{0};
+    /* Number of standard workers blocked in `wait_for`/`wait_any` while running a task. */
+    unsigned                                      m_blocked_std_workers{0};
     unsigned                                      m_max_std_workers{0};
     unsigned                                      m_num_dedicated_workers{0};
     std::deque<lean_task_object *>                m_queues[LEAN_MAX_PRIO+1];
@@ -588,6 +894,9 @@ class task_manager {
     unsigned                                      m_max_prio{0};
     condition_variable                            m_queue_cv;
     condition_variable                            m_task_finished_cv;
+    /* Number of surplus standard workers that are exiting (see `spawn_worker`), and signaled when it drops to zero. */
+    unsigned                                      m_exiting_std_workers{0};
+    condition_variable                            m_worker_exited_cv;
     bool                                          m_shutting_down{false};
 
     lean_task_object * dequeue() {
@@ -616,14 +925,61 @@ class task_manager {
         }
         if (prio > m_max_prio)
             m_max_prio = prio;
+        task_trace(task_event::enqueue, t, prio);
         m_queues[prio].push_back(t);
         m_queues_size++;
-        if (!m_idle_std_workers && m_std_workers.size() < m_max_std_workers)
-            spawn_worker();
-        else
+        if (m_idle_std_workers || m_std_workers.size() - m_blocked_std_workers >= m_max_std_workers || !spawn_worker())
             m_queue_cv.notify_one();
     }
 
+    /* Number of standard workers currently running a task without being blocked on another one. */
+    unsigned num_active_std_workers() const {
+        return m_std_workers.size() - m_idle_std_workers - m_blocked_std_workers;
+    }
+
+    /* Return true if there are more standard workers that are not blocked than the configured parallelism. */
+    bool has_surplus_std_workers() const {
+        return m_std_workers.size() - m_blocked_std_workers > m_max_std_workers;
+    }
+
+    /* A standard worker is about to block waiting for a task. It no longer contributes to the active
+       parallelism, so wake up an idle worker or, if there is none, spawn a compensating one to keep
+       queued tasks running. The pool thus grows by at most one thread per blocked worker, up to
+       `LEAN_MAX_COMPENSATING_WORKERS`; beyond that, or if the thread cannot be created, the worker
+       just blocks. Surplus workers exit once the blocked ones resume (see `spawn_worker`). */
+    void begin_blocking_wait() {
+        m_blocked_std_workers++;
+        if (m_queues_size == 0)
+            return;
+        if (m_idle_std_workers)
+            m_queue_cv.notify_one();
+        else if (m_std_workers.size() < m_max_std_workers + LEAN_MAX_COMPENSATING_WORKERS)
+            spawn_worker();
+    }
+
+    void end_blocking_wait() {
+        lean_assert(m_blocked_std_workers > 0);
+        m_blocked_std_workers--;
+    }
+
+    template<typename P>
+    void wait_task_finished(unique_lock<mutex> & lock, P pred) {
+        if (!g_is_std_worker) {
+            m_task_finished_cv.wait(lock, pred);
+            return;
+        }
+        begin_blocking_wait();
+        m_task_finished_cv.wait(lock, pred);
+        end_blocking_wait();
+    }
+
+    template<typename P>
+    void wait_task_finished(unique_lock<mutex> & lock, lean_task_object * t, P pred) {
+        task_trace(task_event::wait_begin, t);
+        wait_task_finished(lock, pred);
+        task_trace(task_event::wait_end, t);
+    }
+
     void deactivate_task_core(unique_lock<mutex> & lock, lean_task_object * t) {
         object * c              = t->m_imp->m_closure;
         lean_task_object * it   = t->m_imp->m_head_dep;
@@ -642,31 +998,92 @@ class task_manager {
         lock.lock();
     }
 
-    void spawn_worker() {
-        if (m_shutting_down)
-            return;
+    /* Remove the surplus worker `w` from the pool and let its thread exit. */
+    void exit_surplus_worker(unique_lock<mutex> & lock, lthread * w) {
+        auto it = std::find_if(m_std_workers.begin(), m_std_workers.end(),
+                               [&](std::unique_ptr<lthread> const & p) { return p.get() == w; });
+        lean_assert(it != m_std_workers.end());
+        // destroying the `lthread` object detaches the thread
+        m_std_workers.erase(it);
+        m_exiting_std_workers++;
+        lock.unlock();
+        /* Run the thread finalizers now, they may access the task manager, which must not be deleted before. */
+        run_thread_finalizers();
+        lock.lock();
+        if (--m_exiting_std_workers == 0)
+            m_worker_exited_cv.notify_all();
+    }
 
-        m_std_workers.emplace_back(new lthread([this]() {
-            save_stack_info(false);
-            unique_lock<mutex> lock(m_mutex);
-            m_idle_std_workers++;
-            while (true) {
-                if (m_queues_size == 0) {
-                    if (m_shutting_down) {
-                        break;
-                    }
-                    m_queue_cv.wait(lock);
+    /* Main function of a standard worker. `*self` is its thread, which is set by `spawn_worker` while holding the lock. */
+    void std_worker_main(std::shared_ptr<lthread *> const & self) {
+        save_stack_info(false);
+        g_is_std_worker = true;
+        unique_lock<mutex> lock(m_mutex);
+        m_idle_std_workers++;
+        while (true) {
+            if (has_surplus_std_workers() && !m_shutting_down) {
+                /* Compensating workers spawned by `begin_blocking_wait` are not needed anymore since
+                   the blocked workers have resumed: do not exceed the configured parallelism. */
+                m_idle_std_workers--;
+                if (m_queues_size != 0)
+                    m_queue_cv.notify_one(); // we may have consumed the notification meant for another worker
+                exit_surplus_worker(lock, *self);
+                return;
+            }
+            if (m_queues_size == 0) {
+                if (m_shutting_down) {
+                    break;
+                }
+#ifdef LEAN_MT_DEFERRED_DEC
+                /* Do not keep objects alive in the buffer of an idle worker. We must not hold the lock
+                   since releasing objects may deactivate tasks. */
+                if (has_deferred_mt_dec()) {
+                    lock.unlock();
+                    flush_deferred_mt_dec();
+                    lock.lock();
                     continue;
                 }
-
-                lean_task_object * t = dequeue();
-                m_idle_std_workers--;
-                run_task(lock, t);
-                m_idle_std_workers++;
-                reset_heartbeat();
+#endif
+#ifdef LEAN_INCREMENTAL_DEL
+                /* An idle worker finishes releasing the graphs it has dropped. */
+                if (has_pending_del()) {
+                    lock.unlock();
+                    del_pending(LEAN_DEL_SLICE_SIZE);
+                    if (!has_pending_del())
+                        export_thread_heap_objs();
+                    lock.lock();
+                    continue;
+                }
+#endif
+                /* Do not keep the memory of a stack grown by deep recursion while idle. */
+                release_grown_stack();
+                m_queue_cv.wait(lock);
+                continue;
             }
+
+            lean_task_object * t = dequeue();
             m_idle_std_workers--;
-        }));
+            run_task(lock, t);
+            m_idle_std_workers++;
+            reset_heartbeat();
+        }
+        m_idle_std_workers--;
+    }
+
+    /* Spawn a new standard worker. Return false if the thread cannot be created. The lock must be held. */
+    bool spawn_worker() {
+        if (m_shutting_down)
+            return false;
+        std::shared_ptr<lthread *> self = std::make_shared<lthread *>(nullptr);
+        lthread * w;
+        try {
+            w = new lthread([this, self]() { std_worker_main(self); });
+        } catch (std::exception &) {
+            return false;
+        }
+        m_std_workers.emplace_back(w);
+        *self = w;
+        return true;
     }
 
     void spawn_dedicated_worker(lean_task_object * t) {
@@ -693,7 +1110,11 @@ class task_manager {
             object * c = t->m_imp->m_closure;
             t->m_imp->m_closure = nullptr;
             lock.unlock();
+            task_trace(task_event::start, t, t->m_imp->m_prio, g_task_trace_enabled ? task_closure_fn(c) : nullptr);
             v = lean_apply_1(c, box(0));
+            task_trace(task_event::finish, t);
+            /* Release what the task has dropped, e.g. to cancel tasks it does not need anymore. */
+            flush_deferred_dec();
             // If deactivation was delayed by `m_keep_alive`, deactivate after the final execution (`v != nulltpr`)
             if (v != nullptr && t->m_imp->m_keep_alive) {
                 lean_dec_ref((lean_object*)t);
@@ -772,12 +1193,17 @@ public:
             // we can assume that `m_std_workers` will not be changed after this line
         }
         m_queue_cv.notify_all();
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_worker_exited_cv.wait(lock, [&]() { return m_exiting_std_workers == 0; });
+        }
 #ifndef LEAN_EMSCRIPTEN
         // wait for all workers to finish
         for (auto & t : m_std_workers)
             t->join();
         // never seems to terminate under Emscripten
 #endif
+        task_trace_dump();
     }
 
     void enqueue(lean_task_object * t) {
@@ -807,6 +1233,7 @@ public:
             enqueue_core(t2);
             return;
         }
+        task_trace(task_event::dep, t2, t2->m_imp->m_prio, t1);
         t2->m_imp->m_next_dep = t1->m_imp->m_head_dep;
         t1->m_imp->m_head_dep = t2;
     }
@@ -814,21 +1241,24 @@ public:
     void wait_for(lean_task_object * t) {
         if (t->m_value)
             return;
+        /* Releasing deferred objects may be needed for `t` to finish, e.g. by closing a pipe.
+           We must not hold the lock since it may deactivate tasks. */
+        flush_deferred_dec();
         unique_lock<mutex> lock(m_mutex);
         if (t->m_value)
             return;
-        m_task_finished_cv.wait(lock, [&]() { return t->m_value != nullptr; });
+        wait_task_finished(lock, t, [&]() { return t->m_value != nullptr; });
     }
 
     object * wait_any(object * task_list) {
         if (object * t = wait_any_check(task_list))
             return t;
+        /* See `wait_for` */
+        flush_deferred_dec();
         unique_lock<mutex> lock(m_mutex);
-        while (true) {
-            if (object * t = wait_any_check(task_list))
-                return t;
-            m_task_finished_cv.wait(lock);
-        }
+        object * result = nullptr;
+        wait_task_finished(lock, nullptr, [&]() { return (result = wait_any_check(task_list)) != nullptr; });
+        return result;
     }
 
     void deactivate_task(lean_task_object * t) {
@@ -847,6 +1277,7 @@ public:
 
     void cancel(lean_task_object * t) {
         unique_lock<mutex> lock(m_mutex);
+        task_trace(task_event::cancel, t);
         if (t->m_imp)
             t->m_imp->m_canceled = true;
     }
@@ -880,8 +1311,14 @@ extern "C" LEAN_EXPORT void lean_init_task_manager() {
     lean_init_task_manager_using(get_lean_num_threads());
 }
 
+bool has_task_manager() {
+    return g_task_manager != nullptr;
+}
+
 extern "C" LEAN_EXPORT void lean_finalize_task_manager() {
     if (g_task_manager) {
+        // the I/O reactor resolves promises
+        finalize_io_reactor();
         delete g_task_manager;
         g_task_manager = nullptr;
     }
@@ -928,6 +1365,7 @@ static lean_task_object * alloc_task(obj_arg c, unsigned prio, bool keep_alive)
     o->m_imp   = alloc_task_imp(c, prio, keep_alive);
     if (keep_alive)
         lean_inc_ref((lean_object*)o);
+    task_trace(task_event::spawn, o, prio, g_task_trace_enabled ? task_closure_fn(c) : nullptr);
     return o;
 }
 
@@ -1005,6 +1443,19 @@ static obj_res task_bind_fn1(obj_arg x, obj_arg f, obj_arg) {
     return nullptr; /* notify queue that task did not finish yet. */
 }
 
+static void * task_closure_fn(object * c) {
+    if (lean_is_scalar(c) || !lean_is_closure(c))
+        return nullptr;
+    void * fn = lean_closure_fun(c);
+    if (fn == (void*)task_map_fn)
+        return task_closure_fn(lean_closure_arg_cptr(c)[0]);
+    if (fn == (void*)task_bind_fn1)
+        return task_closure_fn(lean_closure_arg_cptr(c)[1]);
+    if (fn == (void*)task_bind_fn2)
+        return nullptr;
+    return fn;
+}
+
 extern "C" LEAN_EXPORT obj_res lean_task_bind_core(obj_arg x, obj_arg f, unsigned prio,
       bool sync, bool keep_alive) {
     if (!g_task_manager || (sync && lean_to_task(x)->m_value)) {
@@ -1081,6 +1532,15 @@ object * alloc_mpz(mpz const & m) {
     return (lean_object*)o;
 }
 
+/* Take ownership of the limbs of `m`. Results of big number operations are computed into a temporary
+   `mpz` and moved into the new object without copying. */
+object * alloc_mpz(mpz && m) {
+    void * mem = lean_alloc_small_object(sizeof(mpz_object));
+    mpz_object * o = new (mem) mpz_object(std::move(m));
+    lean_set_st_header((lean_object*)o, LeanMPZ, 0);
+    return (lean_object*)o;
+}
+
 #ifdef LEAN_USE_GMP
 extern "C" LEAN_EXPORT lean_object * lean_alloc_mpz(mpz_t v) {
     return alloc_mpz(mpz(v));
@@ -1096,11 +1556,16 @@ object * mpz_to_nat_core(mpz const & m) {
     return alloc_mpz(m);
 }
 
-static inline obj_res mpz_to_nat(mpz const & m) {
+object * mpz_to_nat_core(mpz && m) {
+    lean_assert(!m.is_size_t() || m.get_size_t() > LEAN_MAX_SMALL_NAT);
+    return alloc_mpz(std::move(m));
+}
+
+static inline obj_res mpz_to_nat(mpz && m) {
     if (m.is_size_t() && m.get_size_t() <= LEAN_MAX_SMALL_NAT)
         return lean_box(m.get_size_t());
     else
-        return mpz_to_nat_core(m);
+        return mpz_to_nat_core(std::move(m));
 }
 
 extern "C" LEAN_EXPORT object * lean_cstr_to_nat(char const * n) {
@@ -1130,9 +1595,9 @@ extern "C" LEAN_EXPORT object * lean_nat_big_succ(object * a) {
 extern "C" LEAN_EXPORT object * lean_nat_big_add(object * a1, object * a2) {
     lean_assert(!lean_is_scalar(a1) || !lean_is_scalar(a2));
     if (lean_is_scalar(a1))
-        return mpz_to_nat_core(mpz::of_size_t(lean_unbox(a1)) + mpz_value(a2));
+        return mpz_to_nat_core(mpz_value(a2) + static_cast<uint64>(lean_unbox(a1)));
     else if (lean_is_scalar(a2))
-        return mpz_to_nat_core(mpz_value(a1) + mpz::of_size_t(lean_unbox(a2)));
+        return mpz_to_nat_core(mpz_value(a1) + static_cast<uint64>(lean_unbox(a2)));
     else
         return mpz_to_nat_core(mpz_value(a1) + mpz_value(a2));
 }
@@ -1144,7 +1609,7 @@ extern "C" LEAN_EXPORT object * lean_nat_big_sub(object * a1, object * a2) {
         return lean_box(0);
     } else if (lean_is_scalar(a2)) {
         lean_assert(mpz_value(a1) > mpz::of_size_t(lean_unbox(a2)));
-        return mpz_to_nat(mpz_value(a1) - mpz::of_size_t(lean_unbox(a2)));
+        return mpz_to_nat(mpz_value(a1) - static_cast<uint64>(lean_unbox(a2)));
     } else {
         if (mpz_value(a1) < mpz_value(a2))
             return lean_box(0);
@@ -1156,9 +1621,9 @@ extern "C" LEAN_EXPORT object * lean_nat_big_sub(object * a1, object * a2) {
 extern "C" LEAN_EXPORT object * lean_nat_big_mul(object * a1, object * a2) {
     lean_assert(!lean_is_scalar(a1) || !lean_is_scalar(a2));
     if (lean_is_scalar(a1))
-        return mpz_to_nat(mpz::of_size_t(lean_unbox(a1)) * mpz_value(a2));
+        return mpz_to_nat(mpz_value(a2) * static_cast<uint64>(lean_unbox(a1)));
     else if (lean_is_scalar(a2))
-        return mpz_to_nat(mpz_value(a1) * mpz::of_size_t(lean_unbox(a2)));
+        return mpz_to_nat(mpz_value(a1) * static_cast<uint64>(lean_unbox(a2)));
     else
         return mpz_to_nat_core(mpz_value(a1) * mpz_value(a2));
 }
@@ -1175,7 +1640,7 @@ extern "C" LEAN_EXPORT object * lean_nat_big_div(object * a1, object * a2) {
         return lean_box(0);
     } else if (lean_is_scalar(a2)) {
         usize n2 = lean_unbox(a2);
-        return n2 == 0 ? a2 : mpz_to_nat(mpz_value(a1) / mpz::of_size_t(n2));
+        return n2 == 0 ? a2 : mpz_to_nat(mpz_value(a1) / static_cast<uint64>(n2));
     } else {
         lean_assert(mpz_value(a2) != 0);
         return mpz_to_nat(mpz_value(a1) / mpz_value(a2));
@@ -1280,7 +1745,7 @@ extern "C" LEAN_EXPORT lean_obj_res lean_nat_shiftl(b_lean_obj_arg a1, b_lean_ob
     }
     mpz r;
     mul2k(r, a, lean_unbox(a2));
-    return mpz_to_nat(r);
+    return mpz_to_nat(std::move(r));
 }
 
 extern "C" LEAN_EXPORT lean_obj_res lean_nat_shiftr(b_lean_obj_arg a1, b_lean_obj_arg a2) {
@@ -1302,7 +1767,7 @@ extern "C" LEAN_EXPORT lean_obj_res lean_nat_shiftr(b_lean_obj_arg a1, b_lean_ob
     }
     mpz r;
     div2k(r, a, s);
-    return mpz_to_nat(r);
+    return mpz_to_nat(std::move(r));
 }
 
 extern "C" LEAN_EXPORT lean_obj_res lean_nat_pow(b_lean_obj_arg a1, b_lean_obj_arg a2) {
@@ -1346,14 +1811,14 @@ extern "C" LEAN_EXPORT lean_obj_res lean_nat_log2(b_lean_obj_arg a) {
 // =======================================
 // Integers
 
-inline object * mpz_to_int_core(mpz const & m) {
+inline object * mpz_to_int_core(mpz && m) {
     lean_assert(m < LEAN_MIN_SMALL_INT || m > LEAN_MAX_SMALL_INT);
-    return alloc_mpz(m);
+    return alloc_mpz(std::move(m));
 }
 
-static object * mpz_to_int(mpz const & m) {
+static object * mpz_to_int(mpz && m) {
     if (m < LEAN_MIN_SMALL_INT || m > LEAN_MAX_SMALL_INT)
-        return mpz_to_int_core(m);
+        return mpz_to_int_core(std::move(m));
     else
         return lean_box(static_cast<unsigned>(m.get_int()));
 }
@@ -1362,7 +1827,7 @@ extern "C" LEAN_EXPORT lean_obj_res lean_big_int_to_nat(lean_obj_arg a) {
     lean_assert(!lean_is_scalar(a));
     mpz m = mpz_value(a);
     lean_dec(a);
-    return mpz_to_nat(m);
+    return mpz_to_nat(std::move(m));
 }
 
 extern "C" LEAN_EXPORT object * lean_cstr_to_int(char const * n) {
@@ -1995,6 +2460,11 @@ extern "C" LEAN_EXPORT obj_res lean_string_utf8_extract(b_obj_arg s, b_obj_arg b
     /* In the reference implementation if `e` is not pointing to a valid UTF8
        character start position, it is assumed to be at the end. */
     if (e < sz && !is_utf8_first_byte(str[e])) e = sz;
+    if (b == 0 && e == sz) {
+        /* We can share `s`: the extra reference prevents destructive updates to it. */
+        lean_inc_ref(s);
+        return s;
+    }
     usize new_sz = e - b;
     lean_assert(new_sz > 0);
     return lean_mk_string_from_bytes_unchecked(lean_string_cstr(s) + b, new_sz);
@@ -2062,6 +2532,28 @@ extern "C" LEAN_EXPORT obj_res lean_string_of_usize(size_t n) {
     return mk_ascii_string_unchecked(std::to_string(n));
 }
 
+extern "C" LEAN_EXPORT obj_res lean_nat_big_repr(b_obj_arg n) {
+    if (lean_is_scalar(n))
+        return lean_string_of_usize(lean_unbox(n));
+    else
+        return mk_ascii_string_unchecked(mpz_value(n).to_string());
+}
+
+/* Precondition: `s` is a nonempty sequence of decimal digits. */
+extern "C" LEAN_EXPORT obj_res lean_string_dec_to_nat(b_obj_arg s) {
+    usize sz = lean_string_size(s) - 1;
+    char const * str = lean_string_cstr(s);
+    if (sz < 20) {
+        // 10^19 - 1 < 2^64
+        uint64 r = 0;
+        for (usize i = 0; i < sz; i++)
+            r = 10*r + static_cast<uint64>(str[i] - '0');
+        return lean_uint64_to_nat(r);
+    } else {
+        return lean_cstr_to_nat(str);
+    }
+}
+
 // =======================================
 // ByteArray & FloatArray
 
@@ -2341,6 +2833,7 @@ extern "C" LEAN_EXPORT object * lean_dbg_trace(obj_arg s, obj_arg fn) {
 }
 
 extern "C" LEAN_EXPORT object * lean_dbg_sleep(uint32 ms, obj_arg fn) {
+    flush_deferred_dec();
     chrono::milliseconds c(ms);
     this_thread::sleep_for(c);
     return lean_apply_1(fn, lean_box(0));
@@ -2374,6 +2867,9 @@ extern "C" LEAN_EXPORT lean_external_class * lean_register_external_class(lean_e
 void initialize_object() {
     g_ext_classes       = new std::vector<external_object_class*>();
     g_ext_classes_mutex = new mutex();
+    g_thunk_parking_slots = new thunk_parking_slot[LEAN_NUM_THUNK_PARKING_SLOTS];
+    g_foreign_sarrays   = new std::unordered_map<lean_object *, foreign_sarray>();
+    g_foreign_sarrays_mutex = new mutex();
     g_array_empty       = lean_alloc_array(0, 0);
     mark_persistent(g_array_empty);
 }
@@ -2382,5 +2878,8 @@ void finalize_object() {
     for (external_object_class * cls : *g_ext_classes) delete cls;
     delete g_ext_classes;
     delete g_ext_classes_mutex;
+    delete[] g_thunk_parking_slots;
+    delete g_foreign_sarrays;
+    delete g_foreign_sarrays_mutex;
 }
 }
@@ -28,6 +28,7 @@ struct mpz_object {
     mpz         m_value;
     mpz_object() {}
     explicit mpz_object(mpz const & m):m_value(m) {}
+    explicit mpz_object(mpz && m):m_value(std::move(m)) {}
 };
 
 typedef lean_external_class         external_object_class;
@@ -55,6 +56,9 @@ inline void inc(object * o) { lean_inc(o); }
 inline void inc(object * o, size_t n) { lean_inc_n(o, n); }
 inline void dec(object * o) { lean_dec(o); }
 inline void free_heap_obj(object * o) { lean_free_object(o); }
+/* Apply the decrements of multi-threaded objects deferred by the current thread (see `LEAN_MT_DEFERRED_DEC`).
+   Must be called before blocking on an event that releasing these objects could trigger. */
+LEAN_EXPORT void flush_deferred_dec();
 
 inline bool is_cnstr(object * o) { return lean_is_ctor(o); }
 inline bool is_closure(object * o) { return lean_is_closure(o); }
@@ -178,6 +182,7 @@ inline object* apply_m(object* f, unsigned n, object** args) { return lean_apply
 // MPZ
 
 LEAN_EXPORT object * alloc_mpz(mpz const &);
+LEAN_EXPORT object * alloc_mpz(mpz &&);
 inline mpz_object * to_mpz(object * o) { lean_assert(is_mpz(o)); return (mpz_object*)o; }
 
 // =======================================
@@ -281,6 +286,11 @@ public:
     ~scoped_task_manager();
 };
 
+/* `Task.Priority.dedicated` */
+#define LEAN_DEDICATED_PRIO 9
+/* Return `true` if tasks run on worker threads, i.e. the task manager has been initialized. */
+LEAN_EXPORT bool has_task_manager();
+
 inline obj_res task_spawn(obj_arg c, unsigned prio = 0, bool keep_alive = false) { return lean_task_spawn_core(c, prio, keep_alive); }
 inline obj_res task_pure(obj_arg a) { return lean_task_pure(a); }
 inline obj_res task_bind(obj_arg x, obj_arg f, unsigned prio = 0, bool sync = false, bool keep_alive = false) { return lean_task_bind_core(x, f, prio, sync, keep_alive); }
@@ -299,6 +309,13 @@ inline object * alloc_external(external_object_class * cls, void * data) { retur
 inline external_object_class * external_class(object * o) { return lean_get_external_class(o); }
 inline void * external_data(object * o) { return lean_get_external_data(o); }
 
+/* Function releasing the memory `data` of `size` bytes of a foreign scalar array. */
+typedef void (*foreign_sarray_finalizer)(void * data, size_t size); // NOLINT
+/* Register the scalar array `o`, whose memory was not allocated by the runtime (e.g., a mapped file),
+   so that `fn(data, size)` is called instead of freeing `o` when it is deleted. The byte size of `o`
+   must be greater than `LEAN_MAX_SMALL_OBJECT_SIZE`. */
+LEAN_EXPORT void register_foreign_sarray(object * o, foreign_sarray_finalizer fn, void * data, size_t size);
+
 // =======================================
 // Option
 
@@ -310,6 +327,7 @@ inline obj_res mk_option_some(obj_arg v) { obj_res r = alloc_cnstr(1, 1, 0); cns
 
 inline mpz const & mpz_value(b_obj_arg o) { return to_mpz(o)->m_value; }
 LEAN_EXPORT object * mpz_to_nat_core(mpz const & m);
+LEAN_EXPORT object * mpz_to_nat_core(mpz && m);
 inline object * mk_nat_obj_core(mpz const & m) { return mpz_to_nat_core(m); }
 inline obj_res mk_nat_obj(mpz const & m) {
     if (m.is_size_t() && m.get_size_t() <= LEAN_MAX_SMALL_NAT)
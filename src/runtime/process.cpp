@@ -9,6 +9,7 @@ Author: Jared Roesch
 #include <iostream>
 #include <iomanip>
 #include <utility>
+#include <vector>
 #include <system_error>
 
 #if defined(LEAN_WINDOWS)
@@ -24,7 +25,22 @@ Author: Jared Roesch
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <string.h>
 #include <limits.h> // NOLINT
+#if defined(__linux__)
+#include <sys/syscall.h>
+#ifdef SYS_pidfd_open
+#define LEAN_IO_PIDFD
+#endif
+#endif
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if __GLIBC_PREREQ(2, 29)
+// `posix_spawn_file_actions_addchdir_np` was added in glibc 2.29
+#define LEAN_POSIX_SPAWN
+#include <spawn.h>
+extern char ** environ;
+#endif
+#endif
 #endif
 
 #include "runtime/object.h"
@@ -81,6 +97,8 @@ extern "C" LEAN_EXPORT obj_res lean_io_process_get_pid(obj_arg) {
 }
 
 extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait(b_obj_arg, b_obj_arg child, obj_arg) {
+    /* The child may be waiting for us to release objects, e.g. its stdin handle. */
+    flush_deferred_dec();
     HANDLE h = static_cast<HANDLE>(lean_get_external_data(cnstr_get(child, 3)));
     DWORD exit_code;
     if (WaitForSingleObject(h, INFINITE) == WAIT_FAILED) {
@@ -293,13 +311,7 @@ extern "C" LEAN_EXPORT obj_res lean_io_process_get_pid(obj_arg) {
     return lean_io_result_mk_ok(box_uint32(getpid()));
 }
 
-extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait(b_obj_arg, b_obj_arg child, obj_arg) {
-    static_assert(sizeof(pid_t) == sizeof(uint32), "pid_t is expected to be a 32-bit type"); // NOLINT
-    pid_t pid = cnstr_get_uint32(child, 3 * sizeof(object *));
-    int status;
-    if (waitpid(pid, &status, 0) == -1) {
-        return io_result_mk_error(decode_io_error(errno, nullptr));
-    }
+static obj_res wait_status_to_exit_code(int status) {
     if (WIFEXITED(status)) {
         return lean_io_result_mk_ok(box_uint32(static_cast<unsigned>(WEXITSTATUS(status))));
     } else {
@@ -309,6 +321,18 @@ extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait(b_obj_arg, b_obj_arg c
     }
 }
 
+extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait(b_obj_arg, b_obj_arg child, obj_arg) {
+    /* The child may be waiting for us to release objects, e.g. its stdin handle. */
+    flush_deferred_dec();
+    static_assert(sizeof(pid_t) == sizeof(uint32), "pid_t is expected to be a 32-bit type"); // NOLINT
+    pid_t pid = cnstr_get_uint32(child, 3 * sizeof(object *));
+    int status;
+    if (waitpid(pid, &status, 0) == -1) {
+        return io_result_mk_error(decode_io_error(errno, nullptr));
+    }
+    return wait_status_to_exit_code(status);
+}
+
 extern "C" LEAN_EXPORT obj_res lean_io_process_child_kill(b_obj_arg, b_obj_arg child, obj_arg) {
     static_assert(sizeof(pid_t) == sizeof(uint32), "pid_t is expected to be a 32-bit type"); // NOLINT
     pid_t pid = cnstr_get_uint32(child, 3 * sizeof(object *));
@@ -345,15 +369,14 @@ static optional<pipe> setup_stdio(stdio cfg) {
     lean_unreachable();
 }
 
-static obj_res spawn(string_ref const & proc_name, array_ref<string_ref> const & args, stdio stdin_mode, stdio stdout_mode,
-  stdio stderr_mode, option_ref<string_ref> const & cwd, array_ref<pair_ref<string_ref, option_ref<string_ref>>> const & env,
-  bool do_setsid) {
-    /* Setup stdio based on process configuration. */
-    auto stdin_pipe  = setup_stdio(stdin_mode);
-    auto stdout_pipe = setup_stdio(stdout_mode);
-    auto stderr_pipe = setup_stdio(stderr_mode);
+typedef array_ref<pair_ref<string_ref, option_ref<string_ref>>> env_ref;
 
-    int pid = fork();
+static pid_t fork_child(string_ref const & proc_name, array_ref<string_ref> const & args,
+                        stdio stdin_mode, optional<pipe> const & stdin_pipe,
+                        stdio stdout_mode, optional<pipe> const & stdout_pipe,
+                        stdio stderr_mode, optional<pipe> const & stderr_pipe,
+                        option_ref<string_ref> const & cwd, env_ref const & env, bool do_setsid) {
+    pid_t pid = fork();
 
     if (pid == 0) {
         for (auto & entry : env) {
@@ -413,6 +436,105 @@ static obj_res spawn(string_ref const & proc_name, array_ref<string_ref> const &
         throw errno;
     }
 
+    return pid;
+}
+
+#ifdef LEAN_POSIX_SPAWN
+static int add_stdio_action(posix_spawn_file_actions_t * actions, int fd, stdio mode, optional<pipe> const & p) {
+    bool in = fd == STDIN_FILENO;
+    if (p)
+        return posix_spawn_file_actions_adddup2(actions, in ? p->m_read_fd : p->m_write_fd, fd);
+    else if (mode == stdio::NUL)
+        return posix_spawn_file_actions_addopen(actions, fd, "/dev/null", in ? O_RDONLY : O_WRONLY, 0);
+    else
+        return 0;
+}
+
+/*
+  Spawn the child using `posix_spawnp`. In contrast to `fork`, glibc's implementation runs the child in the
+  address space of the parent until `exec` (`clone(CLONE_VM | CLONE_VFORK)`), so it does not have to copy the
+  page tables of a parent with a large heap. Return `false` if the child was not spawned; the caller then falls
+  back to `fork_child`, which also takes care of reporting `exec` failures the usual way.
+*/
+static bool posix_spawn_child(pid_t & pid, string_ref const & proc_name, array_ref<string_ref> const & args,
+                              stdio stdin_mode, optional<pipe> const & stdin_pipe,
+                              stdio stdout_mode, optional<pipe> const & stdout_pipe,
+                              stdio stderr_mode, optional<pipe> const & stderr_pipe,
+                              option_ref<string_ref> const & cwd, env_ref const & env, bool do_setsid) {
+    // `posix_spawnp` resolves the executable using the `PATH` of the parent, not the one of the child
+    for (auto & entry : env) {
+        if (entry.fst() == "PATH")
+            return false;
+    }
+
+    std::vector<std::string> env_entries;
+    buffer<char *> penv;
+    char ** envp = environ;
+    if (env.size() > 0) {
+        for (char ** e = environ; *e; e++) {
+            char const * eq = strchr(*e, '=');
+            size_t key_len = eq ? eq - *e : strlen(*e);
+            bool overridden = false;
+            for (auto & entry : env) {
+                if (entry.fst().num_bytes() == key_len && strncmp(entry.fst().data(), *e, key_len) == 0) {
+                    overridden = true;
+                    break;
+                }
+            }
+            if (!overridden)
+                penv.push_back(*e);
+        }
+        for (auto & entry : env) {
+            if (entry.snd())
+                env_entries.push_back(entry.fst().to_std_string() + "=" + entry.snd().get()->to_std_string());
+        }
+        for (auto & entry : env_entries)
+            penv.push_back(const_cast<char *>(entry.c_str()));
+        penv.push_back(nullptr);
+        envp = penv.data();
+    }
+
+    buffer<char *> pargs;
+    pargs.push_back(const_cast<char *>(proc_name.data()));
+    for (auto & arg : args)
+        pargs.push_back(const_cast<char *>(arg.data()));
+    pargs.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    if (posix_spawn_file_actions_init(&actions) != 0)
+        return false;
+    if (posix_spawnattr_init(&attr) != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return false;
+    }
+    int err = add_stdio_action(&actions, STDIN_FILENO, stdin_mode, stdin_pipe);
+    if (!err) err = add_stdio_action(&actions, STDOUT_FILENO, stdout_mode, stdout_pipe);
+    if (!err) err = add_stdio_action(&actions, STDERR_FILENO, stderr_mode, stderr_pipe);
+    if (!err && cwd) err = posix_spawn_file_actions_addchdir_np(&actions, cwd.get()->data());
+    if (!err && do_setsid) err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+    if (!err) err = posix_spawnp(&pid, pargs[0], &actions, &attr, pargs.data(), envp);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return err == 0;
+}
+#endif
+
+static obj_res spawn(string_ref const & proc_name, array_ref<string_ref> const & args, stdio stdin_mode, stdio stdout_mode,
+  stdio stderr_mode, option_ref<string_ref> const & cwd, env_ref const & env, bool do_setsid) {
+    /* Setup stdio based on process configuration. */
+    auto stdin_pipe  = setup_stdio(stdin_mode);
+    auto stdout_pipe = setup_stdio(stdout_mode);
+    auto stderr_pipe = setup_stdio(stderr_mode);
+
+    pid_t pid;
+#ifdef LEAN_POSIX_SPAWN
+    if (!posix_spawn_child(pid, proc_name, args, stdin_mode, stdin_pipe, stdout_mode, stdout_pipe,
+                           stderr_mode, stderr_pipe, cwd, env, do_setsid))
+#endif
+        pid = fork_child(proc_name, args, stdin_mode, stdin_pipe, stdout_mode, stdout_pipe,
+                         stderr_mode, stderr_pipe, cwd, env, do_setsid);
+
     object * parent_stdin  = box(0);
     object * parent_stdout = box(0);
     object * parent_stderr = box(0);
@@ -451,6 +573,45 @@ void finalize_process() {}
 
 #endif
 
+/* (child : Child cfg) (_ : Unit) : Except IO.Error UInt32 */
+static obj_res child_wait_blocking_fn(obj_arg child, obj_arg) {
+    object * r = lean_io_process_child_wait(box(0), child, io_mk_world());
+    dec(child);
+    return io_result_to_except(r);
+}
+
+/* Child.waitAsync {cfg : @& StdioConfig} : @& Child cfg → BaseIO (Task (Except IO.Error UInt32)) */
+extern "C" LEAN_EXPORT obj_res lean_io_process_child_wait_async(b_obj_arg, b_obj_arg child, obj_arg) {
+#if defined(LEAN_IO_PIDFD)
+    pid_t pid = cnstr_get_uint32(child, 3 * sizeof(object *));
+    // a pidfd becomes readable when the process terminates
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd >= 0) {
+        object * promise = io_new_promise();
+        inc(promise);
+        bool ok = io_reactor_watch(pidfd, false, [=]() {
+            int status;
+            pid_t r = waitpid(pid, &status, WNOHANG);
+            if (r == 0)
+                return false;
+            object * res = r == -1 ? io_result_mk_error(decode_io_error(errno, nullptr)) : wait_status_to_exit_code(status);
+            io_resolve_promise(io_result_to_except(res), promise);
+            dec(promise);
+            return true;
+        });
+        close(pidfd);
+        if (ok)
+            return io_result_mk_ok(promise);
+        dec(promise);
+        dec(promise);
+    }
+#endif
+    object * c = alloc_closure(child_wait_blocking_fn, 1);
+    inc(child);
+    closure_set(c, 0, child);
+    return io_result_mk_ok(task_spawn(c, LEAN_DEDICATED_PRIO));
+}
+
 extern "C" lean_object* lean_mk_io_error_other_error(uint32_t, lean_object*);
 
 extern "C" LEAN_EXPORT obj_res lean_io_process_spawn(obj_arg args_, obj_arg) {
@@ -6,6 +6,8 @@ Author: Sebastian Ullrich
 
 Print a nicer error message on stack overflow.
 Port of the corresponding Rust code (see links below).
+
+On Linux, the same signal handler also grows the stacks of threads created by `lthread` on demand.
 */
 #ifdef LEAN_WINDOWS
 #include <windows.h>
@@ -18,7 +20,20 @@ Port of the corresponding Rust code (see links below).
 #include <cstdlib>
 #include <cstring>
 #include <lean/lean.h>
+#include "runtime/debug.h"
+#include "runtime/thread.h"
 #include "runtime/stack_overflow.h"
+#ifdef LEAN_GROWABLE_STACK
+#include <sys/mman.h>
+#endif
+
+#ifndef LEAN_STACK_GROWTH_CHUNK
+#define LEAN_STACK_GROWTH_CHUNK 1024*1024 // 1Mb
+#endif
+
+#ifndef LEAN_SIGNAL_STACK_SIZE
+#define LEAN_SIGNAL_STACK_SIZE 64*1024 // 64Kb
+#endif
 
 namespace lean {
 // stack guard of the main thread
@@ -44,6 +59,81 @@ stack_guard::stack_guard() {
 
 stack_guard::~stack_guard() {}
 #else
+#ifdef LEAN_GROWABLE_STACK
+static size_t g_page_size = 0;
+// lowest address of the current thread's stack if it is growable, `nullptr` otherwise
+LEAN_THREAD_VALUE(char *, g_stack_limit, nullptr);
+// lowest accessible address of the stack; the stack grows by decreasing it down to `g_stack_limit`
+LEAN_THREAD_VALUE(char *, g_stack_committed, nullptr);
+// value of `g_stack_committed` after `enable_stack_growth`
+LEAN_THREAD_VALUE(char *, g_stack_initial, nullptr);
+
+static char * align_to_page(char * addr) {
+    return reinterpret_cast<char *>(reinterpret_cast<size_t>(addr) & ~(g_page_size - 1));
+}
+
+/* Replace `[begin, end)` by fresh pages. Decommitted pages are not accounted for by the kernel. */
+static bool remap_stack(char * begin, char * end, bool commit) {
+    if (begin == end)
+        return true;
+    int prot  = commit ? PROT_READ | PROT_WRITE : PROT_NONE;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_STACK | (commit ? 0 : MAP_NORESERVE);
+    return mmap(begin, end - begin, prot, flags, -1, 0) != MAP_FAILED;
+}
+
+void enable_stack_growth(size_t initial_size) {
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) return;
+    char * stackaddr;
+    size_t stacksize;
+    int r = pthread_attr_getstack(&attr, reinterpret_cast<void **>(&stackaddr), &stacksize);
+    pthread_attr_destroy(&attr);
+    if (r != 0 || initial_size >= stacksize) return;
+    char x;
+    char * committed = align_to_page(stackaddr + stacksize - initial_size);
+    // we must not decommit the part of the stack in use
+    if (committed + g_page_size > &x || !remap_stack(stackaddr, committed, false)) return;
+    g_stack_limit     = stackaddr;
+    g_stack_committed = committed;
+    g_stack_initial   = committed;
+}
+
+void release_grown_stack() {
+    char * committed = g_stack_committed;
+    char * initial   = g_stack_initial;
+    if (committed == initial) return;
+    lean_assert(initial < static_cast<char *>(__builtin_frame_address(0)));
+    if (remap_stack(committed, initial, false))
+        g_stack_committed = initial;
+}
+
+void disable_stack_growth() {
+    if (!g_stack_limit) return;
+    char * limit   = g_stack_limit;
+    char * initial = g_stack_initial;
+    g_stack_limit = g_stack_committed = g_stack_initial = nullptr;
+    remap_stack(limit, initial, true);
+}
+
+/* Called from the `SIGSEGV` handler: if `addr` is in the decommitted part of the current thread's stack,
+   commit it together with `LEAN_STACK_GROWTH_CHUNK` more bytes and return true. */
+static bool grow_stack(void * addr) {
+    char * a         = static_cast<char *>(addr);
+    char * limit     = g_stack_limit;
+    char * committed = g_stack_committed;
+    if (!limit || a < limit || a >= committed)
+        return false;
+    char * new_committed = static_cast<size_t>(a - limit) > LEAN_STACK_GROWTH_CHUNK ? align_to_page(a - LEAN_STACK_GROWTH_CHUNK) : limit;
+    if (mprotect(new_committed, committed - new_committed, PROT_READ | PROT_WRITE) != 0) {
+        char const msg[] = "\nFailed to grow the stack. Aborting.\n";
+        write(STDERR_FILENO, msg, sizeof(msg) - 1);
+        abort();
+    }
+    g_stack_committed = new_committed;
+    return true;
+}
+#endif
+
 // Install a segfault signal handler and abort with custom message if address is within stack guard.
 // https://github.com/rust-lang/rust/blob/master/src/libstd/sys/unix/stack_overflow.rs
 
@@ -68,6 +158,10 @@ bool is_within_stack_guard(void * addr) {
 }
 
 extern "C" LEAN_EXPORT void segv_handler(int signum, siginfo_t * info, void *) {
+#ifdef LEAN_GROWABLE_STACK
+    if (grow_stack(info->si_addr))
+        return;
+#endif
     if (is_within_stack_guard(info->si_addr)) {
         char const msg[] = "\nStack overflow detected. Aborting.\n";
         write(STDERR_FILENO, msg, sizeof(msg) - 1);
@@ -82,9 +176,11 @@ extern "C" LEAN_EXPORT void segv_handler(int signum, siginfo_t * info, void *) {
 }
 
 stack_guard::stack_guard() {
-    m_signal_stack.ss_sp = malloc(SIGSTKSZ);
+    // large enough for signal handlers unwinding the stack, see `cpu_profiler.cpp`
+    size_t sz = SIGSTKSZ > LEAN_SIGNAL_STACK_SIZE ? SIGSTKSZ : LEAN_SIGNAL_STACK_SIZE;
+    m_signal_stack.ss_sp = malloc(sz);
     if (m_signal_stack.ss_sp == nullptr) return;
-    m_signal_stack.ss_size = SIGSTKSZ;
+    m_signal_stack.ss_size = sz;
     m_signal_stack.ss_flags = 0;
     sigaltstack(&m_signal_stack, nullptr);
 }
@@ -97,7 +193,16 @@ stack_guard::~stack_guard() {
 }
 #endif
 
+#ifndef LEAN_GROWABLE_STACK
+void enable_stack_growth(size_t) {}
+void release_grown_stack() {}
+void disable_stack_growth() {}
+#endif
+
 void initialize_stack_overflow() {
+#ifdef LEAN_GROWABLE_STACK
+    g_page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
     g_stack_guard = new stack_guard();
 #ifdef LEAN_WINDOWS
     AddVectoredExceptionHandler(0, stack_overflow_handler);
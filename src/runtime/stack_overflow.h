@@ -5,9 +5,13 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Sebastian Ullrich
 */
 #pragma once
+#include <cstddef>
 #ifndef LEAN_WINDOWS
 #include <csignal>
 #endif
+#if defined(__linux__) && !defined(LEAN_EMSCRIPTEN) && !defined(LEAN_USE_SPLIT_STACK) && !defined(LEAN_NO_GROWABLE_STACK)
+#define LEAN_GROWABLE_STACK
+#endif
 
 namespace lean {
 class stack_guard {
@@ -20,6 +24,19 @@ public:
     ~stack_guard();
 };
 
+/* Growable stacks (Linux only, no-ops elsewhere).
+
+   `enable_stack_growth` makes only the top `initial_size` bytes of the current thread's stack
+   accessible and decommits the rest. Touching the inaccessible part makes the `SIGSEGV` handler
+   commit more of it, so deep recursion only costs memory when it happens, up to the stack size the
+   thread was created with. The handler must be on the signal stack set up by `stack_guard`. */
+void enable_stack_growth(size_t initial_size);
+/* Decommit the part of the current thread's stack grown since `enable_stack_growth`. Must only be
+   called when the stack is not deeper than its initial size, e.g. by an idle worker. */
+void release_grown_stack();
+/* Make the whole stack accessible again, which the threads library expects when it frees or reuses it. */
+void disable_stack_growth();
+
 void initialize_stack_overflow();
 void finalize_stack_overflow();
 }
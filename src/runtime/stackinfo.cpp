@@ -68,7 +68,8 @@ size_t get_stack_size(bool main) {
         }
         return curr.rlim_cur;
     } else {
-        return lthread::get_thread_stack_size();
+        // the stack may grow beyond its initial size
+        return lthread::get_thread_max_stack_size();
     }
 }
 #endif
@@ -97,6 +98,11 @@ size_t get_used_stack_size() {
     return g_stack_base - curr_stack;
 }
 
+void get_stack_bounds(size_t & lo, size_t & hi) {
+    hi = g_stack_base;
+    lo = g_stack_base > g_stack_size ? g_stack_base - g_stack_size : 0;
+}
+
 size_t get_available_stack_size() {
     size_t sz = get_used_stack_size();
     if (sz > g_stack_size)
@@ -16,11 +16,15 @@ inline size_t get_stack_size(bool ) { return 8192*1024; }
 inline void save_stack_info(bool = true) {}
 inline size_t get_used_stack_size() { return 0; }
 inline size_t get_available_stack_size() { return 8192*1024; }
+inline void get_stack_bounds(size_t & lo, size_t & hi) { lo = hi = 0; }
 #else
 LEAN_EXPORT size_t get_stack_size(bool main);
 LEAN_EXPORT void save_stack_info(bool main = true);
 LEAN_EXPORT size_t get_used_stack_size();
 LEAN_EXPORT size_t get_available_stack_size();
+/* Bounds `[lo, hi)` of the stack of the current thread as saved by `save_stack_info`, or `[0, 0)` if they
+   have not been saved. Memory between the stack pointer and `hi` is accessible. Async-signal-safe. */
+LEAN_EXPORT void get_stack_bounds(size_t & lo, size_t & hi);
 /**
    \brief Throw an exception if the amount of available stack space is low.
 
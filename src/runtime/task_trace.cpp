@@ -0,0 +1,208 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "runtime/debug.h"
+#include "runtime/thread.h"
+#include "runtime/task_trace.h"
+
+#if !defined(LEAN_WINDOWS) && !defined(LEAN_EMSCRIPTEN)
+#include <dlfcn.h>
+#define LEAN_TASK_TRACE_DLADDR
+#endif
+
+#define LEAN_TASK_TRACE_BUFFER_SIZE (1u << 16)
+
+namespace lean {
+std::atomic<bool> g_task_trace_enabled{false};
+static std::string * g_task_trace_file = nullptr;
+
+struct task_trace_event {
+    uint64_t     m_time; // nanoseconds since `g_task_trace_start`
+    void *       m_task;
+    void *       m_other;
+    unsigned     m_prio;
+    task_event   m_kind;
+};
+
+/* Ring buffer of the events of a single thread. Only the owning thread writes to it. */
+struct task_trace_buffer {
+    unsigned          m_tid;
+    /* set while the owning thread records an event, see `task_trace_dump` */
+    std::atomic<bool> m_recording{false};
+    uint64_t          m_num_events{0};
+    task_trace_event  m_events[LEAN_TASK_TRACE_BUFFER_SIZE];
+    explicit task_trace_buffer(unsigned tid):m_tid(tid) {}
+};
+
+static std::chrono::steady_clock::time_point g_task_trace_start;
+static mutex * g_task_trace_mutex = nullptr;
+static std::vector<task_trace_buffer *> * g_task_trace_buffers = nullptr;
+LEAN_THREAD_PTR(task_trace_buffer, g_task_trace_buffer);
+
+static task_trace_buffer * get_task_trace_buffer() {
+    if (task_trace_buffer * b = g_task_trace_buffer)
+        return b;
+    unique_lock<mutex> lock(*g_task_trace_mutex);
+    task_trace_buffer * b = new task_trace_buffer(g_task_trace_buffers->size() + 1);
+    g_task_trace_buffers->push_back(b);
+    g_task_trace_buffer = b;
+    return b;
+}
+
+void task_trace_record(task_event e, lean_task_object * t, unsigned prio, void * other) {
+    task_trace_buffer * b = get_task_trace_buffer();
+    b->m_recording = true;
+    if (!g_task_trace_enabled) {
+        // the events are being written
+        b->m_recording = false;
+        return;
+    }
+    task_trace_event & ev = b->m_events[b->m_num_events % LEAN_TASK_TRACE_BUFFER_SIZE];
+    ev.m_time  = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_task_trace_start).count();
+    ev.m_task  = t;
+    ev.m_other = other;
+    ev.m_prio  = prio;
+    ev.m_kind  = e;
+    b->m_num_events++;
+    b->m_recording.store(false, std::memory_order_release);
+}
+
+static char const * task_event_name(task_event e) {
+    switch (e) {
+    case task_event::spawn:      return "spawn";
+    case task_event::enqueue:    return "enqueue";
+    case task_event::start:      return "run";
+    case task_event::finish:     return "run";
+    case task_event::cancel:     return "cancel";
+    case task_event::dep:        return "dep";
+    case task_event::wait_begin: return "wait";
+    case task_event::wait_end:   return "wait";
+    }
+    lean_unreachable();
+}
+
+static void write_json_string(FILE * out, char const * s) {
+    std::fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\')
+            std::fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            std::fprintf(out, "\\u%04x", c);
+        else
+            std::fputc(c, out);
+    }
+    std::fputc('"', out);
+}
+
+/* Write the symbol containing the code address `fn`, or the address itself if it is unknown. */
+static void write_fn_name(FILE * out, void * fn) {
+#ifdef LEAN_TASK_TRACE_DLADDR
+    Dl_info info;
+    if (dladdr(fn, &info) && info.dli_sname) {
+        write_json_string(out, info.dli_sname);
+        return;
+    }
+#endif
+    std::fprintf(out, "\"%p\"", fn);
+}
+
+static void write_event(FILE * out, unsigned tid, task_trace_event const & ev) {
+    char const * ph;
+    switch (ev.m_kind) {
+    case task_event::start: case task_event::wait_begin: ph = "B"; break;
+    case task_event::finish: case task_event::wait_end:  ph = "E"; break;
+    default: ph = "i"; break;
+    }
+    std::fprintf(out, "{\"name\":");
+    if (ev.m_kind == task_event::start && ev.m_other)
+        write_fn_name(out, ev.m_other);
+    else
+        write_json_string(out, task_event_name(ev.m_kind));
+    std::fprintf(out, ",\"cat\":\"task\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u", ph, ev.m_time / 1000.0, tid);
+    if (*ph == 'i')
+        std::fprintf(out, ",\"s\":\"t\"");
+    if (ev.m_kind == task_event::finish || ev.m_kind == task_event::wait_end) {
+        std::fprintf(out, "}");
+        return;
+    }
+    std::fprintf(out, ",\"args\":{\"task\":\"%p\",\"prio\":%u", ev.m_task, ev.m_prio);
+    if (ev.m_other) {
+        switch (ev.m_kind) {
+        case task_event::spawn:
+            std::fprintf(out, ",\"fn\":");
+            write_fn_name(out, ev.m_other);
+            break;
+        case task_event::dep:
+            std::fprintf(out, ",\"on\":\"%p\"", ev.m_other);
+            break;
+        default:
+            break;
+        }
+    }
+    std::fprintf(out, "}}");
+}
+
+void task_trace_dump() {
+    /* Threads may still be running, e.g. dedicated workers or threads running when the process exits.
+       Since they announce an event in `m_recording` before checking whether tracing is enabled, once
+       it is disabled, we only need to wait for the events already being recorded. Threads that create
+       their buffer later find tracing disabled. */
+    if (!g_task_trace_enabled.exchange(false))
+        return;
+    unique_lock<mutex> lock(*g_task_trace_mutex);
+    for (task_trace_buffer * b : *g_task_trace_buffers) {
+        while (b->m_recording.load(std::memory_order_acquire))
+            this_thread::yield();
+    }
+    FILE * out = std::fopen(g_task_trace_file->c_str(), "w");
+    if (!out) {
+        std::fprintf(stderr, "failed to write task trace to '%s'\n", g_task_trace_file->c_str());
+        return;
+    }
+    std::fprintf(out, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (task_trace_buffer * b : *g_task_trace_buffers) {
+        uint64_t begin = b->m_num_events > LEAN_TASK_TRACE_BUFFER_SIZE ? b->m_num_events - LEAN_TASK_TRACE_BUFFER_SIZE : 0;
+        for (uint64_t i = begin; i < b->m_num_events; i++) {
+            if (!first)
+                std::fprintf(out, ",\n");
+            first = false;
+            write_event(out, b->m_tid, b->m_events[i % LEAN_TASK_TRACE_BUFFER_SIZE]);
+        }
+    }
+    std::fprintf(out, "\n]}\n");
+    std::fclose(out);
+}
+
+void initialize_task_trace() {
+    g_task_trace_mutex   = new mutex();
+    g_task_trace_buffers = new std::vector<task_trace_buffer *>();
+#ifndef LEAN_EMSCRIPTEN
+    if (char const * file = std::getenv("LEAN_TRACE_TASKS")) {
+        if (*file) {
+            g_task_trace_file    = new std::string(file);
+            g_task_trace_start   = std::chrono::steady_clock::now();
+            g_task_trace_enabled = true;
+            // `IO.Process.exit` does not finalize the task manager
+            std::atexit(task_trace_dump);
+        }
+    }
+#endif
+}
+
+void finalize_task_trace() {
+    g_task_trace_enabled = false;
+    for (task_trace_buffer * b : *g_task_trace_buffers)
+        delete b;
+    delete g_task_trace_buffers;
+    delete g_task_trace_mutex;
+    delete g_task_trace_file;
+}
+}
@@ -0,0 +1,43 @@
+/*
+Copyright (c) 2024 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+*/
+#pragma once
+#include <atomic>
+#include <lean/lean.h>
+
+namespace lean {
+/* Opt-in tracer for the events of the task manager.
+
+   Setting the environment variable `LEAN_TRACE_TASKS` to a file name enables it. Each thread records
+   its events in its own fixed-size ring buffer (the oldest events are overwritten when it is full),
+   and the buffers are written in the Chrome trace-event JSON format when the task manager is
+   finalized or the process exits, whichever comes first. The file can be loaded in
+   `chrome://tracing` or Perfetto. */
+enum class task_event : unsigned char {
+    spawn,      // task created; `other` is the function of its closure
+    enqueue,    // task added to a worker queue
+    start,      // worker starts running the task; `other` is the function of its closure
+    finish,     // worker finished running the task
+    cancel,     // cancellation requested
+    dep,        // task waits for the task `other` before being enqueued
+    wait_begin, // thread blocks until the task finishes (`task` is null for `IO.waitAny`)
+    wait_end
+};
+
+extern std::atomic<bool> g_task_trace_enabled;
+
+void task_trace_record(task_event e, lean_task_object * t, unsigned prio, void * other);
+
+inline void task_trace(task_event e, lean_task_object * t, unsigned prio = 0, void * other = nullptr) {
+    if (LEAN_UNLIKELY(g_task_trace_enabled.load(std::memory_order_relaxed)))
+        task_trace_record(e, t, prio, other);
+}
+
+/* Stop recording and write the recorded events to the trace file. Does nothing if tracing is disabled
+   or the events have already been written. */
+void task_trace_dump();
+
+void initialize_task_trace();
+void finalize_task_trace();
+}
@@ -4,6 +4,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <algorithm>
 #include <utility>
 #include <vector>
 #include <iostream>
@@ -23,6 +24,10 @@ Author: Leonardo de Moura
 #define LEAN_DEFAULT_THREAD_STACK_SIZE 8*1024*1024 // 8Mb
 #endif
 
+#ifndef LEAN_DEFAULT_THREAD_MAX_STACK_SIZE
+#define LEAN_DEFAULT_THREAD_MAX_STACK_SIZE 64*1024*1024 // 64Mb
+#endif
+
 namespace lean {
 static std::vector<std::function<void()>> * g_thread_local_reset_fns;
 
@@ -79,6 +84,20 @@ size_t lthread::get_thread_stack_size() {
     return m_thread_stack_size;
 }
 
+size_t lthread::m_thread_max_stack_size = LEAN_DEFAULT_THREAD_MAX_STACK_SIZE;
+
+void lthread::set_thread_max_stack_size(size_t sz) {
+    m_thread_max_stack_size = sz + LEAN_STACK_BUFFER_SPACE;
+}
+
+size_t lthread::get_thread_max_stack_size() {
+#ifdef LEAN_GROWABLE_STACK
+    return std::max(m_thread_stack_size, m_thread_max_stack_size);
+#else
+    return m_thread_stack_size;
+#endif
+}
+
 static runnable mk_thread_proc(runnable const & p, size_t max) {
     return [=]() { set_max_heartbeat(max); p(); }; // NOLINT
 }
@@ -99,6 +118,7 @@ struct lthread::imp {
         m_thread = CreateThread(nullptr, m_thread_stack_size,
                                 _main, f, 0, nullptr);
         if (m_thread == NULL) {
+            delete f;
             throw exception("failed to create thread");
         }
     }
@@ -122,17 +142,22 @@ struct lthread::imp {
 
     static void * _main(void * p) {
         stack_guard guard;
+        enable_stack_growth(m_thread_stack_size);
         thread_main(p);
+        disable_stack_growth();
         return nullptr;
     }
 
     imp(runnable const & p) {
         pthread_attr_init(&m_attr);
-        if (pthread_attr_setstacksize(&m_attr, m_thread_stack_size)) {
+        if (pthread_attr_setstacksize(&m_attr, get_thread_max_stack_size())) {
+            pthread_attr_destroy(&m_attr);
             throw exception("failed to set thread stack size");
         }
         runnable * f = new std::function<void()>(mk_thread_proc(p, get_max_heartbeat()));
         if (pthread_create(&m_thread, &m_attr, _main, f)) {
+            delete f;
+            pthread_attr_destroy(&m_attr);
             throw exception("failed to create thread");
         }
     }
@@ -53,6 +53,7 @@ inline unsigned hardware_concurrency() { return std::thread::hardware_concurrenc
     We implement it using pthreads on OSX/Linux and WinThreads on Windows. */
 class LEAN_EXPORT lthread {
     static size_t m_thread_stack_size;
+    static size_t m_thread_max_stack_size;
     struct imp;
     std::unique_ptr<imp> m_imp;
 public:
@@ -61,6 +62,10 @@ public:
     void join();
     static void set_thread_stack_size(size_t sz);
     static size_t get_thread_stack_size();
+    /* Where stacks are growable (see `enable_stack_growth`), the stack of a thread starts with the
+       thread stack size and can grow up to the maximal stack size if that is larger. */
+    static void set_thread_max_stack_size(size_t sz);
+    static size_t get_thread_max_stack_size();
 };
 }
 
@@ -135,6 +140,8 @@ public:
     void join() {}
     static void set_thread_stack_size(size_t) {}
     static size_t get_thread_stack_size() { return 0; }
+    static void set_thread_max_stack_size(size_t) {}
+    static size_t get_thread_max_stack_size() { return 0; }
 };
 class this_thread {
 public:
@@ -145,6 +152,7 @@ public:
 class mutex {
 public:
     void lock() {}
+    bool try_lock() { return true; }
     void unlock() {}
 };
 class recursive_mutex {
@@ -5,11 +5,20 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include "runtime/debug.h"
 #include "runtime/optional.h"
 #include "runtime/utf8.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LEAN_UTF8_SSE2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LEAN_UTF8_NEON
+#endif
+
 namespace lean {
 bool is_utf8_next(unsigned char c) { return (c & 0xC0) == 0x80; }
 
@@ -32,29 +41,89 @@ unsigned get_utf8_size(unsigned char c) {
         return 1; /* invalid */
 }
 
-extern "C" LEAN_EXPORT size_t lean_utf8_strlen(char const * str) {
+/*
+  Block-wise helpers for the hot loops below. SSE2 and NEON are part of the x86-64 and AArch64
+  baselines, so no runtime dispatch is needed. Other targets process 8 bytes at a time
+  using 64-bit words.
+*/
+
+static inline uint64_t load_u64(uint8_t const * p) {
+    uint64_t r;
+    memcpy(&r, p, sizeof(r));
+    return r;
+}
+
+/* Return the number of leading ASCII bytes in `str[0, size)`. */
+static size_t ascii_prefix_size(uint8_t const * str, size_t size) {
+    size_t i = 0;
+#if defined(LEAN_UTF8_SSE2)
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(str + i));
+        if (_mm_movemask_epi8(v) != 0) break;
+    }
+#elif defined(LEAN_UTF8_NEON)
+    for (; i + 16 <= size; i += 16) {
+        if (vmaxvq_u8(vld1q_u8(str + i)) >= 0x80) break;
+    }
+#endif
+    for (; i + 8 <= size; i += 8) {
+        if ((load_u64(str + i) & 0x8080808080808080ull) != 0) break;
+    }
+    while (i < size && str[i] < 0x80) i++;
+    return i;
+}
+
+/* Return the number of bytes in `str[0, size)` that are not UTF-8 continuation bytes (`10xxxxxx`).
+   This is the number of unicode scalar values if `str` is valid UTF-8. */
+static size_t count_non_continuation_bytes(uint8_t const * str, size_t size) {
     size_t r = 0;
-    while (*str != 0) {
-        unsigned sz = get_utf8_size(*str);
-        r++;
-        str += sz;
+    size_t i = 0;
+#if defined(LEAN_UTF8_SSE2)
+    /* As signed bytes, continuation bytes are exactly the values in [-128, -65].
+       We count them in byte lanes, and sum the lanes before they can overflow. */
+    __m128i const bound = _mm_set1_epi8(-64);
+    __m128i const zero  = _mm_setzero_si128();
+    while (i + 16 <= size) {
+        __m128i num_cont = zero;
+        size_t end = i + 16 * 255 < size ? i + 16 * 255 : size;
+        size_t start = i;
+        for (; i + 16 <= end; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(str + i));
+            num_cont = _mm_sub_epi8(num_cont, _mm_cmplt_epi8(v, bound));
+        }
+        __m128i sums = _mm_sad_epu8(num_cont, zero);
+        r += (i - start) - static_cast<size_t>(_mm_cvtsi128_si32(sums) + _mm_extract_epi16(sums, 4));
+    }
+#elif defined(LEAN_UTF8_NEON)
+    uint8x16_t const mask = vdupq_n_u8(0xC0);
+    uint8x16_t const cont = vdupq_n_u8(0x80);
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t is_cont = vceqq_u8(vandq_u8(vld1q_u8(str + i), mask), cont);
+        r += 16 - vaddvq_u8(vshrq_n_u8(is_cont, 7));
+    }
+#endif
+    for (; i + 8 <= size; i += 8) {
+        uint64_t w = load_u64(str + i);
+        /* bit 7 set and bit 6 unset, moved to bit 0 of each byte and summed up in the top byte */
+        uint64_t c = ((w & ~(w << 1) & 0x8080808080808080ull) >> 7) * 0x0101010101010101ull;
+        r += 8 - static_cast<size_t>(c >> 56);
+    }
+    for (; i < size; i++) {
+        if (!is_utf8_next(str[i])) r++;
     }
     return r;
 }
 
+extern "C" LEAN_EXPORT size_t lean_utf8_strlen(char const * str) {
+    return lean_utf8_n_strlen(str, strlen(str));
+}
+
 size_t utf8_strlen(char const * str) {
     return lean_utf8_strlen(str);
 }
 
 extern "C" LEAN_EXPORT size_t lean_utf8_n_strlen(char const * str, size_t sz) {
-    size_t r = 0;
-    size_t i = 0;
-    while (i < sz) {
-        unsigned d = get_utf8_size(str[i]);
-        r++;
-        i += d;
-    }
-    return r;
+    return count_non_continuation_bytes(reinterpret_cast<uint8_t const *>(str), sz);
 }
 
 size_t utf8_strlen(char const * str, size_t sz) {
@@ -220,7 +289,7 @@ void utf8_decode(std::string const & str, std::vector<unsigned> & out) {
     }
 }
 
-bool validate_utf8_one(uint8_t const * str, size_t size, size_t & pos) {
+static inline bool validate_utf8_one_core(uint8_t const * str, size_t size, size_t & pos) {
     unsigned c = str[pos];
     if ((c & 0x80) == 0) {
         /* zero continuation (0 to 0x7F) */
@@ -267,10 +336,22 @@ bool validate_utf8_one(uint8_t const * str, size_t size, size_t & pos) {
     return true;
 }
 
+bool validate_utf8_one(uint8_t const * str, size_t size, size_t & pos) {
+    return validate_utf8_one_core(str, size, pos);
+}
+
 bool validate_utf8(uint8_t const * str, size_t size, size_t & pos, size_t & i) {
     while (pos < size) {
-        if (!validate_utf8_one(str, size, pos)) return false;
-        i++;
+        if (str[pos] < 0x80) {
+            size_t n = ascii_prefix_size(str + pos, size - pos);
+            pos += n;
+            i   += n;
+        } else {
+            do {
+                if (!validate_utf8_one_core(str, size, pos)) return false;
+                i++;
+            } while (pos < size && str[pos] >= 0x80);
+        }
     }
     return true;
 }
@@ -14,6 +14,7 @@ Author: Leonardo de Moura
 #include <vector>
 #include <set>
 #include "runtime/stackinfo.h"
+#include "runtime/stack_overflow.h"
 #include "runtime/interrupt.h"
 #include "runtime/memory.h"
 #include "runtime/thread.h"
@@ -34,7 +35,10 @@ Author: Leonardo de Moura
 #include "library/formatter.h"
 #include "library/module.h"
 #include "library/time_task.h"
+#include "library/cpu_profiler.h"
+#include "library/name_demangle.h"
 #include "library/compiler/ir.h"
+#include "library/compiler/compiler.h"
 #include "library/print.h"
 #include "initialize/init.h"
 #include "library/compiler/ir_interpreter.h"
@@ -181,10 +185,19 @@ static void display_header(std::ostream & out) {
 }
 
 static void display_features(std::ostream & out) {
-    out << "[";
+    std::vector<char const *> features;
 #if defined(LEAN_LLVM)
-    out << "LLVM";
+    features.push_back("LLVM");
+#endif
+#if defined(LEAN_GROWABLE_STACK)
+    features.push_back("GROWABLE_STACK");
 #endif
+    out << "[";
+    for (size_t i = 0; i < features.size(); i++) {
+        if (i > 0)
+            out << ", ";
+        out << features[i];
+    }
     out << "]\n";
 }
 
@@ -213,6 +226,7 @@ static void display_help(std::ostream & out) {
 #if defined(LEAN_MULTI_THREAD)
     std::cout << "  --threads=num -j   number of threads used to process lean files\n";
     std::cout << "  --tstack=num -s    thread stack size in Kb\n";
+    std::cout << "  --tstack-max=num   size in Kb up to which thread stacks grow on deep recursion (Linux only)\n";
     std::cout << "  --server           start lean in server mode\n";
     std::cout << "  --worker           start lean in server-worker mode\n";
 #endif
@@ -223,6 +237,10 @@ static void display_help(std::ostream & out) {
     std::cout << "  --print-prefix     print the installation prefix for Lean and exit\n";
     std::cout << "  --print-libdir     print the installation directory for Lean's built-in libraries and exit\n";
     std::cout << "  --profile          display elaboration/type checking time for each definition/theorem\n";
+    std::cout << "  --profile-cpu=file sample the CPU usage of lean and write the stacks to the given file\n"
+              << "                     (collapsed stack format, for use with e.g. flamegraph.pl or speedscope)\n";
+    std::cout << "  --demangle         copy stdin to stdout, replacing mangled Lean symbols with declaration names\n"
+              << "                     (e.g. for use with the output of perf)\n";
     std::cout << "  --stats            display environment statistics\n";
     DEBUG_CODE(
     std::cout << "  --debug=tag        enable assertions with the given tag\n";
@@ -233,6 +251,7 @@ static void display_help(std::ostream & out) {
 static int print_prefix = 0;
 static int print_libdir = 0;
 static int json_output = 0;
+static int demangle = 0;
 
 static struct option g_long_options[] = {
     {"version",      no_argument,       0, 'v'},
@@ -246,6 +265,7 @@ static struct option g_long_options[] = {
     {"memory",       required_argument, 0, 'M'},
     {"trust",        required_argument, 0, 't'},
     {"profile",      no_argument,       0, 'P'},
+    {"profile-cpu",  required_argument, 0, 'F'},
     {"stats",        no_argument,       0, 'a'},
     {"quiet",        no_argument,       0, 'q'},
     {"deps",         no_argument,       0, 'd'},
@@ -258,6 +278,7 @@ static struct option g_long_options[] = {
 #if defined(LEAN_MULTI_THREAD)
     {"threads",      required_argument, 0, 'j'},
     {"tstack",       required_argument, 0, 's'},
+    {"tstack-max",   required_argument, 0, 'G'},
     {"server",       no_argument,       0, 'S'},
     {"worker",       no_argument,       0, 'W'},
 #endif
@@ -266,6 +287,7 @@ static struct option g_long_options[] = {
     {"json",         no_argument,       &json_output, 1},
     {"print-prefix", no_argument,       &print_prefix, 1},
     {"print-libdir", no_argument,       &print_libdir, 1},
+    {"demangle",     no_argument,       &demangle, 1},
 #ifdef LEAN_DEBUG
     {"debug",        required_argument, 0, 'B'},
 #endif
@@ -495,6 +517,7 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
     optional<std::string> c_output;
     optional<std::string> llvm_output;
     optional<std::string> root_dir;
+    optional<std::string> cpu_profile_fn;
     buffer<string_ref> forwarded_args;
 
     while (true) {
@@ -536,6 +559,11 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
                         static_cast<size_t>((atoi(optarg) / 4) * 4) * static_cast<size_t>(1024));
                 forwarded_args.push_back(string_ref("-s" + std::string(optarg)));
                 break;
+            case 'G':
+                lean::lthread::set_thread_max_stack_size(
+                        static_cast<size_t>((atoi(optarg) / 4) * 4) * static_cast<size_t>(1024));
+                forwarded_args.push_back(string_ref("--tstack-max=" + std::string(optarg)));
+                break;
             case 'I':
                 use_stdin = true;
                 break;
@@ -599,6 +627,10 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
             case 'P':
                 opts = opts.update("profiler", true);
                 break;
+            case 'F':
+                check_optarg("profile-cpu");
+                cpu_profile_fn = optarg;
+                break;
 #if defined(LEAN_DEBUG)
             case 'B':
                 check_optarg("B");
@@ -624,6 +656,11 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
 
     lean::io_mark_end_initialization();
 
+    if (demangle) {
+        demangle_lean_symbols(std::cin, std::cout);
+        return 0;
+    }
+
     if (print_prefix) {
         std::cout << get_io_result<string_ref>(lean_get_prefix(io_mk_world())).data() << std::endl;
         return 0;
@@ -723,6 +760,7 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
 
         if (!main_module_name)
             main_module_name = name("_stdin");
+        scoped_cpu_profiler cpu_profiler(cpu_profile_fn);
         pair_ref<environment, object_ref> r = run_new_frontend(contents, opts, mod_fn, *main_module_name, trust_lvl, ilean_fn, json_output);
         env = r.fst();
         bool ok = unbox(r.snd().raw());
@@ -762,7 +800,10 @@ extern "C" LEAN_EXPORT int lean_main(int argc, char ** argv) {
                         lean_io_mk_world()));
         }
 
+        if (cpu_profile_fn)
+            stop_cpu_profiler();
         display_cumulative_profiling_times(std::cerr);
+        display_cumulative_compiler_stats(std::cerr);
 
 #ifdef LEAN_SMALL_ALLOCATOR
         // If the small allocator is not enabled, then we assume we are not using the sanitizer.
@@ -0,0 +1,23 @@
+/-! Big number arithmetic: multiplication and division of numbers with tens of thousands of digits.
+Run it against builds with and without `USE_GMP` to compare the two backends. -/
+
+/-- Product of the numbers in `[lo, hi)`, split in halves so that the factors stay balanced. -/
+partial def prodRange (lo hi : Nat) : Nat :=
+  if hi - lo ≤ 8 then Id.run do
+    let mut p := 1
+    for i in [lo:hi] do
+      p := p * i
+    return p
+  else
+    let mid := (lo + hi) / 2
+    prodRange lo mid * prodRange mid hi
+
+def main : List String → IO Unit
+  | [n] => do
+    let n := n.toNat!
+    let f := prodRange 1 (n+1)
+    let g := prodRange 1 (n/2+1)
+    IO.println f.log2
+    IO.println (f / g % 1000000007)
+    IO.println (f % (g + 1) % 1000000007)
+  | _ => throw $ IO.userError "give factorial argument"
@@ -0,0 +1,19 @@
+/-!
+Several tasks repeatedly traverse the same array. The array is shared between threads, so its
+elements are multi-threaded objects and every access updates their reference counts atomically.
+Compare builds with and without `-DMT_DEFERRED_DEC=ON` to measure the cost of these updates.
+-/
+
+def traverse (arr : Array (Nat × Nat)) (rounds : Nat) : Nat := Id.run do
+  let mut s := 0
+  for _ in [0:rounds] do
+    for p in arr do
+      s := s + p.1 + p.2
+  return s
+
+def main : List String → IO Unit
+  | [tasks, size, rounds] => do
+    let arr := (Array.range size.toNat!).map fun i => (i, 2 * i)
+    let ts := (List.range tasks.toNat!).map fun _ => Task.spawn fun _ => traverse arr rounds.toNat!
+    IO.println (ts.foldl (fun s t => s + t.get) 0)
+  | _ => throw <| IO.userError "give number of tasks, array size and number of rounds"
@@ -0,0 +1,15 @@
+/-! Decimal conversion of big naturals: `Nat.repr` and `String.toNat?` on numbers with many digits. -/
+
+def main : List String → IO Unit
+  | [n] => do
+    let n := n.toNat!
+    let mut len := 0
+    let mut ok := true
+    for i in [1:11] do
+      let x := 3 ^ (n * i) + i
+      let s := x.repr
+      len := len + s.length
+      ok := ok && s.toNat? == some x
+    IO.println len
+    IO.println ok
+  | _ => throw $ IO.userError "give exponent"
@@ -0,0 +1,15 @@
+/-! Contention on a shared `IO.Ref`: several tasks concurrently update and read the same ref. -/
+
+def worker (r : IO.Ref Nat) (iters : Nat) : IO Unit := do
+  for _ in [0:iters] do
+    r.modify (· + 1)
+    discard <| r.get
+
+def main : List String → IO Unit
+  | [tasks, iters] => do
+    let r ← IO.mkRef 0
+    let ts ← (List.range tasks.toNat!).mapM fun _ => IO.asTask (worker r iters.toNat!)
+    for t in ts do
+      IO.ofExcept (← IO.wait t)
+    IO.println (← r.get)
+  | _ => throw <| IO.userError "give number of tasks and iterations"
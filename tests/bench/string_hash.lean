@@ -0,0 +1,22 @@
+import Lean.Data.HashMap
+open Lean
+
+/-! String hashing: `HashMap String` inserts and lookups, and hashing of `Name`s built from strings. -/
+
+def main : List String → IO Unit
+  | [n] => do
+    let n := n.toNat!
+    let keys := (Array.range n).map fun i => s!"Lean.Meta.Simp.Config.field{i}"
+    let mut m : HashMap String Nat := mkHashMap
+    for i in [0:n] do
+      m := m.insert keys[i]! i
+    let mut sum := 0
+    for _ in [0:10] do
+      for k in keys do
+        sum := sum + (m.find? k).getD 0
+    IO.println sum
+    let mut names : HashMap Name Nat := mkHashMap
+    for k in keys do
+      names := names.insert (.str (.str .anonymous "Lean") k) k.length
+    IO.println names.size
+  | _ => throw <| IO.userError "give number of keys"
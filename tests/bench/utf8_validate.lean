@@ -0,0 +1,19 @@
+/-! Decoding UTF-8 input with `String.fromUTF8?`, which validates the bytes and computes the length. -/
+
+def asciiLine := "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"text\":\"theorem foo : 1 + 1 = 2 := rfl\"}}\n"
+def multibyteLine := "∀ x ∈ s, ∃ y, f x = y ∧ (λ α β → γ) ⟨a, b⟩ ≤ c ≠ d 数学 𝔽\n"
+
+def mkInput : String → Option ByteArray
+  | "ascii"     => some (String.join (List.replicate 10000 asciiLine)).toUTF8
+  | "multibyte" => some (String.join (List.replicate 10000 multibyteLine)).toUTF8
+  | _           => none
+
+def main : List String → IO Unit
+  | [kind, iters] => do
+    let some bytes := mkInput kind | throw <| IO.userError "kind must be `ascii` or `multibyte`"
+    let mut len := 0
+    for _ in [0:iters.toNat!] do
+      let some s := String.fromUTF8? bytes | throw <| IO.userError "invalid UTF-8"
+      len := len + s.length
+    IO.println len
+  | _ => throw <| IO.userError "give input kind and number of iterations"
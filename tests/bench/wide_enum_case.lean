@@ -0,0 +1,153 @@
+/-! Pattern matching over a wide enumeration. Each step of the loop dispatches twice on a
+64-constructor enum, which exercises the code generated for `case` on dense tags. -/
+
+inductive Op where
+  | op0 | op1 | op2 | op3 | op4 | op5 | op6 | op7
+  | op8 | op9 | op10 | op11 | op12 | op13 | op14 | op15
+  | op16 | op17 | op18 | op19 | op20 | op21 | op22 | op23
+  | op24 | op25 | op26 | op27 | op28 | op29 | op30 | op31
+  | op32 | op33 | op34 | op35 | op36 | op37 | op38 | op39
+  | op40 | op41 | op42 | op43 | op44 | op45 | op46 | op47
+  | op48 | op49 | op50 | op51 | op52 | op53 | op54 | op55
+  | op56 | op57 | op58 | op59 | op60 | op61 | op62 | op63
+
+/-- A permutation of `Op`, `op i ↦ op ((5 * i + 3) % 64)`. -/
+def Op.next : Op → Op
+  | .op0 => .op3
+  | .op1 => .op8
+  | .op2 => .op13
+  | .op3 => .op18
+  | .op4 => .op23
+  | .op5 => .op28
+  | .op6 => .op33
+  | .op7 => .op38
+  | .op8 => .op43
+  | .op9 => .op48
+  | .op10 => .op53
+  | .op11 => .op58
+  | .op12 => .op63
+  | .op13 => .op4
+  | .op14 => .op9
+  | .op15 => .op14
+  | .op16 => .op19
+  | .op17 => .op24
+  | .op18 => .op29
+  | .op19 => .op34
+  | .op20 => .op39
+  | .op21 => .op44
+  | .op22 => .op49
+  | .op23 => .op54
+  | .op24 => .op59
+  | .op25 => .op0
+  | .op26 => .op5
+  | .op27 => .op10
+  | .op28 => .op15
+  | .op29 => .op20
+  | .op30 => .op25
+  | .op31 => .op30
+  | .op32 => .op35
+  | .op33 => .op40
+  | .op34 => .op45
+  | .op35 => .op50
+  | .op36 => .op55
+  | .op37 => .op60
+  | .op38 => .op1
+  | .op39 => .op6
+  | .op40 => .op11
+  | .op41 => .op16
+  | .op42 => .op21
+  | .op43 => .op26
+  | .op44 => .op31
+  | .op45 => .op36
+  | .op46 => .op41
+  | .op47 => .op46
+  | .op48 => .op51
+  | .op49 => .op56
+  | .op50 => .op61
+  | .op51 => .op2
+  | .op52 => .op7
+  | .op53 => .op12
+  | .op54 => .op17
+  | .op55 => .op22
+  | .op56 => .op27
+  | .op57 => .op32
+  | .op58 => .op37
+  | .op59 => .op42
+  | .op60 => .op47
+  | .op61 => .op52
+  | .op62 => .op57
+  | .op63 => .op62
+
+def Op.weight : Op → UInt64
+  | .op0 => 1
+  | .op1 => 2
+  | .op2 => 5
+  | .op3 => 10
+  | .op4 => 17
+  | .op5 => 26
+  | .op6 => 37
+  | .op7 => 50
+  | .op8 => 65
+  | .op9 => 82
+  | .op10 => 101
+  | .op11 => 122
+  | .op12 => 145
+  | .op13 => 170
+  | .op14 => 197
+  | .op15 => 226
+  | .op16 => 257
+  | .op17 => 290
+  | .op18 => 325
+  | .op19 => 362
+  | .op20 => 401
+  | .op21 => 442
+  | .op22 => 485
+  | .op23 => 530
+  | .op24 => 577
+  | .op25 => 626
+  | .op26 => 677
+  | .op27 => 730
+  | .op28 => 785
+  | .op29 => 842
+  | .op30 => 901
+  | .op31 => 962
+  | .op32 => 1025
+  | .op33 => 1090
+  | .op34 => 1157
+  | .op35 => 1226
+  | .op36 => 1297
+  | .op37 => 1370
+  | .op38 => 1445
+  | .op39 => 1522
+  | .op40 => 1601
+  | .op41 => 1682
+  | .op42 => 1765
+  | .op43 => 1850
+  | .op44 => 1937
+  | .op45 => 2026
+  | .op46 => 2117
+  | .op47 => 2210
+  | .op48 => 2305
+  | .op49 => 2402
+  | .op50 => 2501
+  | .op51 => 2602
+  | .op52 => 2705
+  | .op53 => 2810
+  | .op54 => 2917
+  | .op55 => 3026
+  | .op56 => 3137
+  | .op57 => 3250
+  | .op58 => 3365
+  | .op59 => 3482
+  | .op60 => 3601
+  | .op61 => 3722
+  | .op62 => 3845
+  | .op63 => 3970
+
+def loop : Nat → Op → UInt64 → UInt64
+  | 0,   _,  acc => acc
+  | n+1, op, acc => loop n op.next (acc * 31 + op.weight)
+
+def main : List String → IO Unit
+  | [n] => IO.println (loop n.toNat! .op0 0)
+  | _   => throw <| IO.userError "give number of iterations"
@@ -0,0 +1,16 @@
+/-! Dropping large graphs, which are released in slices when the runtime is built with `-DINCREMENTAL_DEL=ON`. -/
+
+@[noinline] def mkBig (n : Nat) (shared : Array Nat) : Array (List (Array Nat)) :=
+  (Array.range n).map fun i => [#[i], shared]
+
+@[noinline] def sum (xs : Array Nat) : Nat :=
+  xs.foldl (· + ·) 0
+
+def main : IO Unit := do
+  let mut shared := Array.range 100
+  for round in [0:5] do
+    let big := mkBig 200000 shared
+    IO.println s!"{big.size} {sum big[round]!.head!}"
+    -- `big` is dropped here, but it may not have been released completely before `shared` is updated
+    shared := shared.modify 0 (· + 1)
+  IO.println (sum shared)
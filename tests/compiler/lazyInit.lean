@@ -0,0 +1,18 @@
+/-! Closed terms computed on first access when compiled with `-DLEAN_LAZY_INIT` (see `lazyInit.lean.lazy_init`). -/
+
+@[noinline] def table (n : Nat) : Nat :=
+  -- the list and the string below are closed terms
+  (List.range 1000).foldl (· + ·) n + "closed term".length
+
+@[noinline] def nested (n : Nat) : List Nat :=
+  -- a closed term referring to another closed term
+  (List.range 10).map (· * (List.range 100).length) ++ [n]
+
+def main : IO Unit := do
+  -- threads racing on the first access must all observe the same value
+  let tasks ← (List.range 8).mapM fun i => IO.asTask (pure (table i, nested i))
+  for t in tasks do
+    match ← IO.wait t with
+    | .ok (a, b) => IO.println s!"{a} {b.length} {b.head!} {b.getLast!}"
+    | .error e => throw e
+  IO.println (table 0)
@@ -0,0 +1,22 @@
+/-! Chains of comparisons against literals are emitted as `switch`es. -/
+
+@[noinline] def natCase : Nat → String
+  | 0 => "zero"
+  | 1 => "one"
+  | 2 => "two"
+  | 7 => "seven"
+  | 100 => "hundred"
+  | _ => "other"
+
+@[noinline] def uint8Case : UInt8 → Nat
+  | 3 => 30
+  | 4 => 40
+  | 5 => 50
+  | 255 => 2550
+  | _ => 0
+
+def main : IO Unit := do
+  for n in [0, 1, 2, 3, 7, 100, 101, 2^64, 2^64 + 1] do
+    IO.println s!"{n} {natCase n}"
+  for n in [0, 3, 4, 5, 6, 255] do
+    IO.println s!"{n} {uint8Case n.toUInt8}"
@@ -8,6 +8,14 @@ compile_lean_c_backend
 exec_check "./$f.out"
 diff_produced
 
+if [ -f "$f.lazy_init" ]; then
+    echo "running C program with lazily initialized closed terms..."
+    rm "./$f.out" || true
+    compile_lean_c_backend -DLEAN_LAZY_INIT
+    exec_check "./$f.out"
+    diff_produced
+fi
+
 # Then check the LLVM version
 if lean_has_llvm_support; then
     echo "running LLVM program..."
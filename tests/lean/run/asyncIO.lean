@@ -0,0 +1,41 @@
+open IO.Process
+
+def testPipes : IO Unit := do
+  let child ← spawn { cmd := "cat", stdin := .piped, stdout := .piped }
+  -- the read stays pending until `cat` echoes what we write
+  let read ← child.stdout.readAsync 100
+  let write ← child.stdin.writeAsync "hello\n".toUTF8
+  IO.ofExcept (← IO.wait write)
+  assert! String.fromUTF8! (← IO.ofExcept (← IO.wait read)) == "hello\n"
+  -- a larger buffer than a pipe holds is written in several steps while `cat` runs
+  let big := String.mk (List.replicate 200000 'x') ++ "\n"
+  let write ← child.stdin.writeAsync big.toUTF8
+  let mut received := 0
+  while received < big.length do
+    let chunk ← IO.ofExcept (← IO.wait (← child.stdout.readAsync 65536))
+    assert! chunk.size > 0
+    received := received + chunk.size
+  IO.ofExcept (← IO.wait write)
+  -- closing stdin terminates `cat`
+  let (_, child) ← child.takeStdin
+  let wait ← child.waitAsync
+  assert! (← IO.ofExcept (← IO.wait wait)) == 0
+  -- end of file
+  assert! (← IO.ofExcept (← IO.wait (← child.stdout.readAsync 100))).size == 0
+
+def testExitCode : IO Unit := do
+  let child ← spawn { cmd := "sh", args := #["-c", "exit 3"] }
+  assert! (← IO.ofExcept (← IO.wait (← child.waitAsync))) == 3
+
+def testFiles : IO Unit := do
+  let fn := "asyncIO.txt"
+  IO.FS.withFile fn .write fun h => do
+    IO.ofExcept (← IO.wait (← h.writeAsync "abc".toUTF8))
+  IO.FS.withFile fn .read fun h => do
+    assert! String.fromUTF8! (← IO.ofExcept (← IO.wait (← h.readAsync 100))) == "abc"
+    assert! (← IO.ofExcept (← IO.wait (← h.readAsync 100))).size == 0
+  IO.FS.removeFile fn
+
+#eval testPipes
+#eval testExitCode
+#eval testFiles
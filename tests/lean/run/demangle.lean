@@ -0,0 +1,58 @@
+import Lean
+open Lean
+
+/-! `lean --demangle` must invert `Name.mangle` on the symbols emitted by the code generator. -/
+
+def names : List Name := [
+  `Nat.add,
+  `Lean.Meta.whnf,
+  `Lean.Meta.whnf._rarg,
+  `List.map._at.Foo.bar._spec_1,
+  `Foo.x_1,
+  `Foo.__y,
+  Name.mkNum `Foo.bar 3,
+  (Name.mkNum `Foo 3).str "baz",
+  (Name.mkNum `_private.Foo 0).str "bar",
+  Name.mkStr `Foo "α",
+  Name.mkStr `Foo "𝔽",
+  Name.mkStr `Foo "a.b",
+  Name.mkStr `Foo "a b"
+]
+
+/-- Symbols that are not mangled names of declarations. -/
+def others : List (String × String) := [
+  (Name.mangle `Foo.x "_init_l_", "[init] Foo.x"),
+  (mkModuleInitializationFunctionName `Init.Data, "[init] module Init.Data"),
+  ("main", "main"),
+  ("lean_apply_1", "lean_apply_1"),
+  ("l_", "l_"),
+  ("0x1234 in l_Nat_add () at lib.so", "0x1234 in Nat.add () at lib.so")
+]
+
+def writeLines (h : IO.FS.Handle) (ls : List String) : IO Unit := do
+  for l in ls do
+    h.putStrLn l
+  h.flush
+
+def demangle (syms : List String) : IO (List String) := do
+  let child ← IO.Process.spawn {
+    cmd := (← IO.appPath).toString
+    args := #["--demangle"]
+    stdin := .piped
+    stdout := .piped
+  }
+  let (stdin, child) ← child.takeStdin
+  -- `stdin` is closed once written, ending the input
+  writeLines stdin syms
+  let out ← child.stdout.readToEnd
+  let rc ← child.wait
+  assert! rc == 0
+  return (out.splitOn "\n").dropLast
+
+#eval show IO Unit from do
+  let cases := names.map (fun n => (n.mangle, n.toString (escape := false))) ++ others
+  let out ← demangle (cases.map (·.1))
+  assert! out.length == cases.length
+  for ((sym, expected), actual) in cases.zip out do
+    unless actual == expected do
+      throw <| IO.userError s!"demangling '{sym}' produced '{actual}', expected '{expected}'"
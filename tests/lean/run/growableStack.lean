@@ -0,0 +1,45 @@
+/-!
+Where thread stacks are growable, a task may recurse past the initial stack size (`--tstack`) up to
+`--tstack-max`, beyond which deep recursion is still reported.
+-/
+
+def program (n : Nat) : String := s!"
+partial def deep (n : Nat) : Nat := if n == 0 then 0 else deep (n - 1) + 1
+#eval (Task.spawn (fun _ => deep {n}) .dedicated).get
+"
+
+def writeInput (h : IO.FS.Handle) (input : String) : IO Unit := do
+  h.putStr input
+  h.flush
+
+/-- Run `program n` with the given stack sizes in Kb, returning the output. -/
+def runLean (n initial max : Nat) : IO String := do
+  let child ← IO.Process.spawn {
+    cmd := (← IO.appPath).toString
+    args := #[s!"--tstack={initial}", s!"--tstack-max={max}", "--stdin"]
+    stdin := .piped
+    stdout := .piped
+    stderr := .piped
+  }
+  let (stdin, child) ← child.takeStdin
+  -- `stdin` is closed once written, ending the input
+  writeInput stdin (program n)
+  let stdout ← IO.asTask child.stdout.readToEnd .dedicated
+  let stderr ← child.stderr.readToEnd
+  discard <| child.wait
+  return (← IO.ofExcept stdout.get) ++ stderr
+
+def contains (s pat : String) : Bool :=
+  (s.splitOn pat).length > 1
+
+#eval show IO Unit from do
+  let features ← IO.Process.run { cmd := (← IO.appPath).toString, args := #["--features"] }
+  unless contains features "GROWABLE_STACK" do
+    return
+  -- far deeper than 1Mb, far less than 256Mb
+  let out ← runLean 30000 1024 (256 * 1024)
+  unless contains out "30000" do
+    throw <| IO.userError s!"recursion in a growable stack failed:\n{out}"
+  let out ← runLean 1000000000 1024 4096
+  unless contains out "deep recursion was detected" do
+    throw <| IO.userError s!"recursion beyond --tstack-max was not reported:\n{out}"
@@ -0,0 +1,32 @@
+import Lean
+open Lean
+
+/-! Chains of comparisons against literals are emitted as `switch`es, see `tests/compiler/litSwitch.lean`. -/
+
+def natCase : Nat → String
+  | 0 => "zero"
+  | 1 => "one"
+  | 2 => "two"
+  | 7 => "seven"
+  | 100 => "hundred"
+  | _ => "other"
+
+def uint8Case : UInt8 → Nat
+  | 3 => 30
+  | 4 => 40
+  | 5 => 50
+  | 255 => 2550
+  | _ => 0
+
+def contains (s pat : String) : Bool :=
+  (s.splitOn pat).length > 1
+
+#eval show CoreM Unit from do
+  let env ← getEnv
+  let c ← IO.ofExcept <| IR.emitC env env.mainModule
+  assert! contains c "switch (lean_is_scalar(x_1) ? lean_unbox(x_1) : SIZE_MAX) {"
+  assert! contains c "switch (x_1) {"
+  for k in [0, 1, 2, 7, 100, 3, 4, 5, 255] do
+    assert! contains c s!"case {k}:"
+  -- no comparison of the chains is left
+  assert! !contains c "lean_nat_dec_eq"
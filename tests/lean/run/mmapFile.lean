@@ -0,0 +1,25 @@
+open IO.FS
+
+def testMmap : IO Unit := do
+  let fn := "mmapFile.bin"
+  let data := ByteArray.mk <| (Array.range 100000).map (·.toUInt8)
+  writeBinFile fn data
+  for _ in [0:100] do
+    let a ← mmapFile fn
+    assert! a.size == data.size
+    assert! a.data == data.data
+    -- updates do not write through to the file
+    let b := a.set! 0 42
+    assert! b.get! 0 == 42
+  assert! (← readBinFile fn).data == data.data
+  -- small files are read
+  writeBinFile fn "abc".toUTF8
+  assert! (← mmapFile fn).data == "abc".toUTF8.data
+  writeBinFile fn ByteArray.empty
+  assert! (← mmapFile fn).size == 0
+  removeFile fn
+  match ← (mmapFile fn).toBaseIO with
+  | .ok _ => throw <| IO.userError "mapping a missing file should fail"
+  | .error _ => pure ()
+
+#eval testMmap
@@ -0,0 +1,33 @@
+/-!
+With `LEAN_PERF_MAP` set, interpreted declarations are called through trampolines. Exceptions
+thrown by the interpreter, such as the one reporting a stack overflow, must unwind through them.
+-/
+
+def input : String := "
+partial def deep (n : Nat) : Nat := if n == 0 then 0 else deep (n - 1) + 1
+#eval deep 10
+#eval deep 1000000000
+"
+
+def writeInput (h : IO.FS.Handle) : IO Unit := do
+  h.putStr input
+  h.flush
+
+#eval show IO Unit from do
+  let child ← IO.Process.spawn {
+    cmd := (← IO.appPath).toString
+    args := #["--stdin"]
+    env := #[("LEAN_PERF_MAP", some "1")]
+    stdin := .piped
+    stdout := .piped
+  }
+  let (stdin, child) ← child.takeStdin
+  -- `stdin` is closed once written, ending the input
+  writeInput stdin
+  let out ← child.stdout.readToEnd
+  let rc ← child.wait
+  -- an uncaught exception would abort the process
+  unless rc == 1 do
+    throw <| IO.userError s!"unexpected exit code {rc}, output:\n{out}"
+  assert! (out.splitOn "10\n").length > 1
+  assert! (out.splitOn "deep recursion was detected").length > 1
@@ -0,0 +1,30 @@
+open IO.FS
+
+def check_eq {α} [BEq α] [Repr α] (tag : String) (expected actual : α) : IO Unit :=
+  unless (expected == actual) do
+    throw <| IO.userError s!"assertion failure \"{tag}\":\n  expected: {repr expected}\n  actual:   {repr actual}"
+
+def testReadDelim : IO Unit := do
+  let fn := "readDelim.txt"
+  -- a line longer than the line buffer retained by a thread, an empty line, and no trailing line break
+  let long := String.mk (List.replicate 100000 'x')
+  writeFile fn s!"a,b\n{long}\n\nlast"
+  check_eq "lines" #["a,b", long, "", "last"] (← lines fn)
+  withFile fn .read fun h => do
+    check_eq "readLines" #["a,b", long, "", "last"] (← h.readLines)
+    check_eq "readLines at EOF" #[] (← h.readLines)
+  withFile fn .read fun h => do
+    check_eq "readUntil 1" "a,".toUTF8.toList (← h.readUntil ','.toNat.toUInt8).toList
+    check_eq "readUntil 2" "b\n".toUTF8.toList (← h.readUntil '\n'.toNat.toUInt8).toList
+    check_eq "readUntil 3" (long ++ "\n").length (← h.readUntil '\n'.toNat.toUInt8).size
+    check_eq "getLine" "\n" (← h.getLine)
+    -- the last chunk is returned without a delimiter
+    check_eq "readUntil 4" "last".toUTF8.toList (← h.readUntil '\n'.toNat.toUInt8).toList
+    check_eq "readUntil at EOF" 0 (← h.readUntil '\n'.toNat.toUInt8).size
+  writeFile fn "one\ntwo\n"
+  check_eq "trailing line break" #["one", "two"] (← lines fn)
+  writeFile fn ""
+  check_eq "empty file" #[] (← lines fn)
+  removeFile fn
+
+#eval testReadDelim
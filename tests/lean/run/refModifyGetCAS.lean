@@ -0,0 +1,18 @@
+def casWorker (r : IO.Ref Nat) (iters : Nat) : IO Unit := do
+  for _ in [0:iters] do
+    discard <| r.modifyGetCAS fun n => (n, n + 1)
+    discard <| r.get
+
+def casTest : IO Unit := do
+  let r ← IO.mkRef 0
+  let ts ← (List.range 8).mapM fun _ => IO.asTask (casWorker r 1000)
+  for t in ts do
+    IO.ofExcept (← IO.wait t)
+  assert! (← r.get) == 8000
+  -- single-threaded reference
+  let s ← IO.mkRef "a"
+  let old ← s.modifyGetCAS fun v => (v, v ++ "b")
+  assert! old == "a"
+  assert! (← s.get) == "ab"
+
+#eval casTest
@@ -0,0 +1,24 @@
+/-!
+Values taken out of a multi-threaded ref by `take` (as in `modify`) or `swap` must not be freed
+while other threads are still reading them from the ref.
+-/
+
+def writer (r : IO.Ref (List Nat)) (iters : Nat) : IO Unit := do
+  for i in [0:iters] do
+    r.modify fun _ => [i, i + 1]
+    discard <| r.swap [i + 1, i + 2]
+
+def reader (r : IO.Ref (List Nat)) (iters : Nat) : IO Unit := do
+  for _ in [0:iters] do
+    match (← r.get) with
+    | [a, b] => assert! b == a + 1
+    | _ => throw <| IO.userError "unexpected value"
+
+def raceTest : IO Unit := do
+  let r ← IO.mkRef [0, 1]
+  let ws ← (List.range 2).mapM fun _ => IO.asTask (writer r 100000) .dedicated
+  let rs ← (List.range 4).mapM fun _ => IO.asTask (reader r 100000) .dedicated
+  for t in ws ++ rs do
+    IO.ofExcept (← IO.wait t)
+
+#eval raceTest
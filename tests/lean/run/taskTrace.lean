@@ -0,0 +1,49 @@
+import Lean
+open Lean
+
+/-!
+Setting `LEAN_TRACE_TASKS` makes `lean` write the task manager events to the given file in the
+Chrome trace-event format, also when the process ends through `IO.Process.exit`.
+-/
+
+def program (exit : Bool) : String := s!"
+def work (n : Nat) : Nat := (List.range n).foldl (· + ·) 0
+#eval do
+  let ts := (List.range 20).map fun i => Task.spawn fun _ => work (1000 * i)
+  let dedicated ← IO.asTask (pure (work 1000)) .dedicated
+  discard <| IO.wait dedicated
+  IO.println (ts.map Task.get).length
+{if exit then "#eval IO.Process.exit 0" else ""}
+"
+
+def writeInput (h : IO.FS.Handle) (input : String) : IO Unit := do
+  h.putStr input
+  h.flush
+
+def checkTrace (exit : Bool) : IO Unit := do
+  let file : System.FilePath := s!"taskTrace{exit}.json"
+  if ← file.pathExists then
+    IO.FS.removeFile file
+  let child ← IO.Process.spawn {
+    cmd := (← IO.appPath).toString
+    args := #["--stdin"]
+    env := #[("LEAN_TRACE_TASKS", some file.toString)]
+    stdin := .piped
+    stdout := .piped
+  }
+  let (stdin, child) ← child.takeStdin
+  -- `stdin` is closed once written, ending the input
+  writeInput stdin (program exit)
+  let out ← child.stdout.readToEnd
+  let rc ← child.wait
+  unless rc == 0 do
+    throw <| IO.userError s!"unexpected exit code {rc}, output:\n{out}"
+  let json ← IO.ofExcept <| Json.parse (← IO.FS.readFile file)
+  let events ← IO.ofExcept <| json.getObjValAs? (Array Json) "traceEvents"
+  let names := events.filterMap fun e => (e.getObjValAs? String "name").toOption
+  assert! names.contains "spawn"
+  assert! names.contains "enqueue"
+  IO.FS.removeFile file
+
+#eval checkTrace false
+#eval checkTrace true